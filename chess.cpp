@@ -1,319 +1,363 @@
-#include "iostream"
-#include "stdio.h"
-#include <vector>
-#include <queue>
-#include <list>
-
-#include <string>
-
-#define NDEBUG
-#include <cassert>
-
-
-/*
-1) Король    K (king)
-2) Ферзь     Q (queen)
-3) Ладья     R (rook)
-4) Конь      N (kNight)
-5) Слон      B (bishop)
-6) Пешка     P(pawn)
-
-
-Chess::Desk - вложенный класс, описывает текущую ситуацию на поле
-
-Формат входных данных в файле:
-целые числа, разделенные пробелом и переводом строки
-Первая строка вида:
-P W B
-где
-P - количество ходов из условия задачи
-W - количество белых фигур на доске
-B - количество черных фигур на доске
-далее N строк вида:
-A X Y
-где
-A - номер фигуры (тип)
-X - положение фигуры на доске по координате X (от левого края)
-Y - положение фигуры на доске по координате Y (от нижнего ряда)
-далее M строк вида:
-A X Y
-
-Поле 1 1 (A1) находится в нижнем левом углу доски
-Фигуры нумеруются от одного до семи в независимости от цвета
-1) Король    K (king)
-2) Ферзь     Q (queen)
-3) Ладья     R (rook)
-4) Конь      N (kNight)
-5) Слон      B (bishop)
-6) Пешка     P (pawn)
-7) Пешка, последний ход которой был двухшаговым
-   (Возможно взятие на проходе)
-*/
-
-
-class Chess
+#include "chess.h"
+
+#ifndef _WIN32
+    #include <fcntl.h>
+    #include <sys/mman.h>
+    #include <sys/stat.h>
+    #include <unistd.h>
+#endif
+
+#ifdef __BMI2__
+    #include <immintrin.h>
+#endif
+
+Chess::Chess()
 {
-    public:
-        
-        Chess();
-        
-        struct pieceForIn
-        {
-            int pieceType;
-            int xPosition;
-            int yPosition;
-        };
-
-        struct plyForOut
-        {
-            int plyNo;
-            int pieceType;
-            int pieceSymbol;
-            int xSourceField;
-            int ySourceField;
-            int xDestinationField;
-            int yDestinationField;
-            bool isCastling;
-            int whichPieceIfPromotion;
-        };
-
-        enum OperatingMode : int
-        {
-            Generator = 0,//Стандартный режим генерации ходов
-            CheckTest = 1,//Режим проверки на шах
-            FinalPly = 2 //Завершить генерацию сразу после генерации первого доступного полухода
-        };
-        
-        enum Settings : int
-        {
-            //задание параметров игрового поля в соответствии с шахматными правилами
-            
-            DeskSizeX = 8,
-            DeskSizeY = 8,
-            
-            XKingCPosition = 5,
-            XLeftRookCPosition = 1,
-            XRightRookCPosition = 8,
-            YWhiteKingCLine = 1,
-            YBlackKingCLine = 8,
-            
-            YWhiteStartPawnLine = 2, //Линяя, стоя на которой пешка может сделать двухшаговый ход
-            YWhitePromotionLine = 7, //Линяя, стоя на которую пешка может сделать ход и сразу превратиться
-            YBlackStartPawnLine = 7,
-            YBlackPromotionLine = 2,
-            
-            AmountTypesOfPieces = 6,
-            MaxPlys = 50
-        };
+    //таблицы атак общие для всех экземпляров, заполняются один раз
+    static const bool isTablesReady = BitBoards::initTables() && Zobrist::initKeys();
+    assert(isTablesReady);
+    (void)isTablesReady;
+    
+    totalPlys = 0;
+    isColorsSwapped = false;
+    isShortestMateSearch = false;
+    hashMegaBytes = DefaultHashMegaBytes;
+    threadsAmount = DefaultThreadsAmount;
+    pool = NULL;
+    proofNodesLimit = DefaultProofNodesLimit;
+    clearRefutations();
+    //дерево решений сбрасывается между задачами с сохранением емкости
+    solutionNodes.reserve(SolutionNodesReserve);
+    searchAllocationsAmount = 0;
+    nodesAmount = 0;
+    isPrinting = true;
+}
+
+//Счетчик выделений памяти в куче, заданный программой (NULL - счетчика нет)
+static heapAllocationsCounter heapAllocationsCounterHook = NULL;
+
+void setHeapAllocationsCounter(const heapAllocationsCounter counter)
+{
+    heapAllocationsCounterHook = counter;
+}
+
+static inline unsigned long long getHeapAllocationsAmount()
+{
+    return heapAllocationsCounterHook != NULL ? heapAllocationsCounterHook() : 0;
+}
+
+Chess::HashKey Chess::Zobrist::pieceKeys[2][AmountTypesOfPieces + 1][DeskSizeX * DeskSizeY];
+Chess::HashKey Chess::Zobrist::blackTurnKey;
+Chess::HashKey Chess::Zobrist::castlingKeys[16];
+Chess::HashKey Chess::Zobrist::enPassantKeys[DeskSizeX];
+
+//"Магические" числа для ладьи и слона (найдены перебором случайных
+//разреженных чисел, индекс в таблице - старшие биты произведения)
+static const Chess::BitBoard rookMagicNumbers[Chess::DeskSizeX * Chess::DeskSizeY] =
+{
+    0x1080004008801020ULL, 0x0840092002C03000ULL, 0x1900200010400900ULL,
+    0x0880100008000480ULL, 0x4200100420080200ULL, 0x8100020100080400ULL,
+    0x0200040110886200ULL, 0x0200008040220411ULL, 0x0404800084400220ULL,
+    0x0000401000402000ULL, 0x0086001081220440ULL, 0x0408800800100280ULL,
+    0x000A001201040820ULL, 0x8848800200840080ULL, 0x4001000100040200ULL,
+    0x0442000102105084ULL, 0x9080010020804100ULL, 0x0040404000201009ULL,
+    0x0000808010002009ULL, 0x2200090021D00100ULL, 0x0008008008040080ULL,
+    0x0004004002010040ULL, 0x0011040008015042ULL, 0x00000A0001768104ULL,
+    0x0000800080204009ULL, 0x2010004140002001ULL, 0x9800200280100080ULL,
+    0x1000100080080080ULL, 0x0442000A00049020ULL, 0x2100040080020080ULL,
+    0x0800120400900148ULL, 0x0010040A00128541ULL, 0x2800804000800030ULL,
+    0x1010002000400041ULL, 0x4000200011004100ULL, 0x0610008410800800ULL,
+    0x0400802402800800ULL, 0xC100020080800400ULL, 0x0002000802000401ULL,
+    0x0182085882000401ULL, 0x0220204000808000ULL, 0x2860100040024022ULL,
+    0x0001002004110040ULL, 0x99101042000A0020ULL, 0x0004080004008080ULL,
+    0x0010040002008080ULL, 0x2012004881020004ULL, 0x8300842444820011ULL,
+    0x0088403882010200ULL, 0x0820400080210100ULL, 0x0110910040A00300ULL,
+    0x0801100280080480ULL, 0x0242009008200600ULL, 0x1002000489500200ULL,
+    0x0040800200010080ULL, 0x0091800041000080ULL, 0x0000209300488001ULL,
+    0x04C1002414824001ULL, 0x020020000B001041ULL, 0x7000100004200901ULL,
+    0x8002002004100802ULL, 0x30010002084C0007ULL, 0x0888221800813004ULL,
+    0x4000002840840112ULL
+};
+
+static const Chess::BitBoard bishopMagicNumbers[Chess::DeskSizeX * Chess::DeskSizeY] =
+{
+    0x2048017020910100ULL, 0x0044410424008008ULL, 0x040828A400900000ULL,
+    0x8002209200022000ULL, 0x0002021000540002ULL, 0x0021018840000000ULL,
+    0x00009E8420204002ULL, 0x00A0920110084480ULL, 0x4003062018010110ULL,
+    0x0221046812004E09ULL, 0x01E11002958912A0ULL, 0x0000044410804000ULL,
+    0x0000821210000080ULL, 0x080201102210A800ULL, 0x0080040411045004ULL,
+    0x00704A1842021000ULL, 0x1005061070322800ULL, 0x0018001010410444ULL,
+    0x0010000800401420ULL, 0x2204002844000800ULL, 0x2052020412022280ULL,
+    0x000A020101008208ULL, 0x0040400201042000ULL, 0x03E1082040480410ULL,
+    0x1004200004208414ULL, 0x08700400984808C8ULL, 0x0088080004004410ULL,
+    0x008C0240140100A2ULL, 0x0008840001822000ULL, 0x0050088001080100ULL,
+    0x98140840040A2200ULL, 0x3002020900210110ULL, 0x1004040640206000ULL,
+    0x1090909000840400ULL, 0x9002444810100020ULL, 0x4000020080080080ULL,
+    0x0028020400011010ULL, 0x0290808300020100ULL, 0x8010020882004410ULL,
+    0x0604010040082C20ULL, 0x20040104C0801008ULL, 0x6004208424001050ULL,
+    0x1002840041000800ULL, 0x0200042018000102ULL, 0xA8002000A0821C00ULL,
+    0x0040080802201910ULL, 0x0222620444000100ULL, 0x0002080041020088ULL,
+    0x1500820110401050ULL, 0x0000492090100080ULL, 0x0900410041100000ULL,
+    0x0302000420880000ULL, 0x0010501202020020ULL, 0x0008200490049040ULL,
+    0x0462080214A40120ULL, 0x2421310102008100ULL, 0x2400420080884060ULL,
+    0x0800804406184208ULL, 0x0B0080124A084400ULL, 0x082E082300840412ULL,
+    0x6051049040082200ULL, 0xC610211002102101ULL, 0x0000048808010433ULL,
+    0x0010200804405440ULL
+};
+
+//Таблицы атак Chess::BitBoards, общие для всех экземпляров Chess
+//(заполняются один раз в BitBoards::initTables)
+static const int BoardSquaresAmount = Chess::DeskSizeX * Chess::DeskSizeY;
+
+struct slidingMagic
+{
+    Chess::BitBoard mask; //значимые для луча поля (без краёв доски)
+    Chess::BitBoard magicNumber;
+    int shift;
+    Chess::BitBoard *attacks;
+};
+
+static Chess::BitBoard kingAttacks[BoardSquaresAmount];
+static Chess::BitBoard kNightAttacks[BoardSquaresAmount];
+static Chess::BitBoard pawnAttacks[2][BoardSquaresAmount];
+static signed char kingSquares[BoardSquaresAmount][8];
+static signed char kNightSquares[BoardSquaresAmount][8];
+static Chess::BitBoard rays[BoardSquaresAmount][8];
+static Chess::BitBoard between[BoardSquaresAmount][BoardSquaresAmount];
+
+static slidingMagic rookMagics[BoardSquaresAmount];
+static slidingMagic bishopMagics[BoardSquaresAmount];
+static Chess::BitBoard rookTable[0x19000];
+static Chess::BitBoard bishopTable[0x1480];
+
+static inline unsigned int getMagicIndex(const slidingMagic *const m,
+                                         const Chess::BitBoard occupied)
+{
+    #ifdef __BMI2__
+        return (unsigned int)_pext_u64(occupied, m->mask);
+    #else
+        return (unsigned int)(((occupied & m->mask) * m->magicNumber) >> m->shift);
+    #endif
+}
+
+inline Chess::BitBoard Chess::BitBoards::getKingAttacks(const int square)
+    {return kingAttacks[square];}
+inline Chess::BitBoard Chess::BitBoards::getKNightAttacks(const int square)
+    {return kNightAttacks[square];}
+inline const signed char *Chess::BitBoards::getKingSquares(const int square)
+    {return kingSquares[square];}
+inline const signed char *Chess::BitBoards::getKNightSquares(const int square)
+    {return kNightSquares[square];}
+inline Chess::BitBoard Chess::BitBoards::getRay(const int square, const int q)
+    {return rays[square][q];}
+inline Chess::BitBoard Chess::BitBoards::getBetween(const int square1, const int square2)
+    {return between[square1][square2];}
+inline Chess::BitBoard Chess::BitBoards::getPawnAttacks(const bool isWhite, const int square)
+    {return pawnAttacks[isWhite ? 0 : 1][square];}
+inline Chess::BitBoard Chess::BitBoards::getRookAttacks(const int square,
+                                                        const BitBoard occupied)
+    {return rookMagics[square].attacks[getMagicIndex(&rookMagics[square], occupied)];}
+inline Chess::BitBoard Chess::BitBoards::getBishopAttacks(const int square,
+                                                          const BitBoard occupied)
+    {return bishopMagics[square].attacks[getMagicIndex(&bishopMagics[square], occupied)];}
+inline Chess::BitBoard Chess::BitBoards::getQueenAttacks(const int square,
+                                                         const BitBoard occupied)
+    {return getRookAttacks(square, occupied) | getBishopAttacks(square, occupied);}
+
+static Chess::BitBoard getSlidingAttacks(const int square, const Chess::BitBoard occupied,
+                                         const bool isRook)
+{
+    //Медленный расчёт атак дальнобойной фигуры проходом по лучам,
+    //используется только при заполнении таблиц
+    const int rookDirections[4][2] = {{0, 1}, {1, 0}, {0, -1}, {-1, 0}};
+    const int bishopDirections[4][2] = {{1, 1}, {1, -1}, {-1, -1}, {-1, 1}};
+    
+    Chess::BitBoard attacks = 0;
+    int xNewPosition = 0;
+    int yNewPosition = 0;
+    
+    for(int q = 0; q < 4; q++)
+    {
+        int xMovingMultiplier = isRook ? rookDirections[q][0] : bishopDirections[q][0];
+        int yMovingMultiplier = isRook ? rookDirections[q][1] : bishopDirections[q][1];
         
-        enum PieceType : int
+        xNewPosition = Chess::BitBoards::getXPosition(square) + xMovingMultiplier;
+        yNewPosition = Chess::BitBoards::getYPosition(square) + yMovingMultiplier;
+        while(xNewPosition >= 1 && xNewPosition <= Chess::DeskSizeX &&
+              yNewPosition >= 1 && yNewPosition <= Chess::DeskSizeY)
         {
-            //Задание внутренних идентификаторов для разных видов фигур,
-            //для пустой клетки и для "бортика", обрамляющего поле.
-            
-            Empty = 0,
-            
-            WhiteKing = 1,
-            WhiteQueen = 2,
-            WhiteRook = 3,
-            WhiteKNight = 4,
-            WhiteBishop = 5,
-            WhitePawn = 6,
-            
-            BlackIdSum = 100,
-            
-            BlackKing = WhiteKing + BlackIdSum,
-            BlackQueen = WhiteQueen + BlackIdSum,
-            BlackRook = WhiteRook + BlackIdSum,
-            BlackKNight = WhiteKNight + BlackIdSum,
-            BlackBishop = WhiteBishop + BlackIdSum,
-            BlackPawn = WhitePawn + BlackIdSum,
-            
-            DeskBorder = 200
-        };
-        
-        struct ply
-        {
-            int plyNo;
-            int movingPieceType;
-            int xSourceField;
-            int ySourceField;
-            int xDestinationField;
-            int yDestinationField;
-            int whichPieceIfTaking;
-            bool isCastling;
-            int whichPieceIfPromotion;
-            bool isEnPassantPossiblePrevious;
-            int xPosMovedPawnPrevious, yPosMovedPawnPrevious;
-            bool isWhiteShortCPermitPrevious, isWhiteLongCPermitPrevious;
-            bool isBlackShortCPermitPrevious, isBlackLongCPermitPrevious;
-        };
-        
-        char getPieceSymbol(const int pieceID);
+            Chess::BitBoard bit =
+                Chess::BitBoards::getBit(Chess::BitBoards::getSquare(xNewPosition, yNewPosition));
+            attacks |= bit;
+            if(occupied & bit){break;}
+            xNewPosition += xMovingMultiplier;
+            yNewPosition += yMovingMultiplier;
+        }
+    }
+    
+    return attacks;
+}
+
+static void initMagics(slidingMagic *const magics, Chess::BitBoard *const table,
+                       const Chess::BitBoard *const magicNumbers, const bool isRook)
+{
+    int tableSize = 0;
+    
+    for(int square = 0; square < BoardSquaresAmount; square++)
+    {
+        //поля на краю доски не влияют на атаки, в маску не входят
+        const int xPosition = Chess::BitBoards::getXPosition(square);
+        const int yPosition = Chess::BitBoards::getYPosition(square);
+        Chess::BitBoard edges =
+            ((0x0101010101010101ULL | 0x8080808080808080ULL) &
+             ~(0x0101010101010101ULL << (xPosition - 1))) |
+            ((0x00000000000000FFULL | 0xFF00000000000000ULL) &
+             ~(0x00000000000000FFULL << (Chess::DeskSizeX * (yPosition - 1))));
         
-        void printDesk(const bool isPreviousPositionShow,
-                       const int xPreviousPosition,
-                       const int yPreviousPosition);
-
-        void loadChessProblem(const bool isWhiteFirst,
-                              const bool isEnPassant,
-                              const int xPawnPosIfEnPassant,
-                              const int yPawnPosIfEnPassant,
-                              const int nMoves,
-                              std::list<pieceForIn> * const pieces);
+        slidingMagic *m = &magics[square];
+        m->mask = getSlidingAttacks(square, 0, isRook) & ~edges;
+        m->magicNumber = magicNumbers[square];
+        m->shift = BoardSquaresAmount - __builtin_popcountll(m->mask);
+        m->attacks = table + tableSize;
         
-        bool computeResolutionRecursion(const int nPlysRest,
-                                        const ply *const childPly,
-                                        std::queue< std::list<ply> > *const childSolutions);
-                                 
-        void compute(std::list< std::list<plyForOut> > * const solutionsForOut);
+        //перебор всех подмножеств маски
+        Chess::BitBoard subset = 0;
+        do
+        {
+            Chess::BitBoard attacks = getSlidingAttacks(square, subset, isRook);
+            unsigned int index = getMagicIndex(m, subset);
+            //разные подмножества могут попасть в один индекс
+            //только при совпадающих атаках
+            assert(subset == 0 || m->attacks[index] == 0 || m->attacks[index] == attacks);
+            m->attacks[index] = attacks;
+            subset = (subset - m->mask) & m->mask;
+        }
+        while(subset != 0);
         
-        //отладочные функции и данные
-        void printTesting();
-        bool test();
-        void computeTest();
-        void loadTestOut(FILE *f);
-        std::list<ply> testing;
-        std::list<ply> testingOut;
+        tableSize += (1 << __builtin_popcountll(m->mask));
+    }
+    
+    assert(tableSize == (isRook ? 0x19000 : 0x1480));
+}
+
+bool Chess::BitBoards::initTables()
+{
+    const int kingSteps[8][2] = {{0, 1}, {1, 1}, {1, 0}, {1, -1},
+                                 {0, -1}, {-1, -1}, {-1, 0}, {-1, 1}};
+    const int kNightSteps[8][2] = {{1, 2}, {2, 1}, {2, -1}, {1, -2},
+                                   {-1, -2}, {-2, -1}, {-2, 1}, {-1, 2}};
+    const int rayDirections[8][2] = {{0, 1}, {1, 0}, {0, -1}, {-1, 0},
+                                     {1, 1}, {1, -1}, {-1, -1}, {-1, 1}};
+    
+    int xNewPosition = 0;
+    int yNewPosition = 0;
+    
+    for(int square = 0; square < DeskSizeX * DeskSizeY; square++)
+    {
+        kingAttacks[square] = 0;
+        kNightAttacks[square] = 0;
+        pawnAttacks[0][square] = 0;
+        pawnAttacks[1][square] = 0;
         
-    private:
+        int kingAmount = 0;
+        int kNightAmount = 0;
+        for(int q = 0; q <= 7; q++)
+        {
+            kingSquares[square][q] = -1;
+            kNightSquares[square][q] = -1;
+        }
         
-        class Desk
+        for(int q = 0; q <= 7; q++)
         {
-            private:
-                
-                int desk[DeskSizeX + 2][DeskSizeY + 2];
-                
-                bool isWhiteTurn;
-                
-                bool isWhiteShortCPermit, isWhiteLongCPermit;
-                bool isBlackShortCPermit, isBlackLongCPermit;
-                
-                bool isEnPassantPossible;
-                int xPosMovedPawn, yPosMovedPawn;
-                
-                inline void moveRookForCastling(const int xKingDestinationField,
-                                                const int yKingDestinationField);
-                
-                int xWhiteKing, yWhiteKing, xBlackKing, yBlackKing;
-                
-                void initKingPositions();
-                void initDesk();
-                void setField(const int xPosition, const int yPosition,
-                              const int PieceType)
-                {
-                    desk[xPosition][yPosition] = PieceType;
-                }
-                
-                std::vector<ply> previousPlys;
-                
-            public:
-                Desk();
-                
-                void switchTurn(){isWhiteTurn = !isWhiteTurn;}
-                
-                inline bool getIsWhiteTurn(){return isWhiteTurn;}
-                
-                inline int getField(const int xPosition, const int yPosition)
-                {
-                    assert(xPosition >= 0 && yPosition >= 0);
-                    assert(xPosition <= DeskSizeX + 1 &&
-                           yPosition <= DeskSizeY + 1 );
-                    
-                    return desk[xPosition][yPosition];
-                }
-                
-                //bool setIsWhiteTurn(bool is){isWhiteTurn = is;}
-                
-                inline bool getIsEnPassantPossible()
-                {return isEnPassantPossible;}
-                inline int getXPosMovedPawn(){return xPosMovedPawn;}
-                inline int getYPosMovedPawn(){return yPosMovedPawn;}
-                
-                inline int getXWhiteKingPosition(){return xWhiteKing;}
-                inline int getYWhiteKingPosition(){return yWhiteKing;}
-                inline int getXBlackKingPosition(){return xBlackKing;}
-                inline int getYBlackKingPosition(){return yBlackKing;}
-                
-                inline bool getIsWhiteShortCPermit()
-                {return (isWhiteShortCPermit);}
-                inline bool getIsWhiteLongCPermit()
-                {return (isWhiteLongCPermit);}
-                inline bool getIsBlackShortCPermit()
-                {return (isBlackShortCPermit);}
-                inline bool getIsBlackLongCPermit()
-                {return (isBlackLongCPermit);}
-                
-                void makeMoveAhead(const ply newMove,
-                                   const bool isTurnChanging);
-                void makeMoveBack(const bool isTurnChanging);
+            xNewPosition = getXPosition(square) + kingSteps[q][0];
+            yNewPosition = getYPosition(square) + kingSteps[q][1];
+            if(xNewPosition >= 1 && xNewPosition <= DeskSizeX &&
+               yNewPosition >= 1 && yNewPosition <= DeskSizeY)
+            {
+                kingAttacks[square] |= getBit(getSquare(xNewPosition, yNewPosition));
+                kingSquares[square][kingAmount++] = getSquare(xNewPosition, yNewPosition);
                 
-                void setDesk(const bool isWhiteFirst,
-                             const bool isEnPassant,
-                             const int xPawnPosIfEnPassant,
-                             const int yPawnPosIfEnPassant,
-                             const int totalPlys,
-                             std::list<pieceForIn> * const pieces);
+                //пешка бьёт по диагонали вперёд
+                if(kingSteps[q][0] != 0 && kingSteps[q][1] == 1)
+                    {pawnAttacks[0][square] |= getBit(getSquare(xNewPosition, yNewPosition));}
+                if(kingSteps[q][0] != 0 && kingSteps[q][1] == -1)
+                    {pawnAttacks[1][square] |= getBit(getSquare(xNewPosition, yNewPosition));}
+            }
             
-                bool operator == (const Desk &d1);//для отладки
-        };
-        
-        Desk desk;
-        //void printPiece(int pieceID);
-        
-        int totalPlys;
-        
-        void addMove(std::queue<ply> *plys,
-                     const OperatingMode mode,
-                     const int xSourceField,
-                     const int ySourceField,
-                     const int xDestinationField,
-                     const int yDestinationField,
-                     const int whichPieceIfTaking,
-                     const int isCastling,
-                     const int whichPieceIfPromotion);
-        
-        bool getIsFieldUnderAttack(const int xPosition, const int yPosition);
-        
-        void generateAllPlys(std::queue<ply> *plys,
-                             const OperatingMode mode);
-        bool generateKing(std::queue<ply> *plys, const int xPosition,
-                          const int yPosition, const OperatingMode mode);
-        bool generateQueen(std::queue<ply> *plys, const int xPosition,
-                          const int yPosition, const OperatingMode mode);
-        bool generateRook(std::queue<ply> *plys, const int xPosition,
-                          const int yPosition, const OperatingMode mode);
-        bool generateKNight(std::queue<ply> *plys, const int xPosition,
-                            const int yPosition, const OperatingMode mode);
-        bool generateBishop(std::queue<ply> *plys, const int xPosition,
-                            const int yPosition, const OperatingMode mode);
-        bool generatePawn(std::queue<ply> *plys, const int xPosition,
-                          const int yPosition, const OperatingMode mode);
-        bool generateQRB(std::queue<ply> *plys, const bool isMovingLikeRook,
-                         const bool isMovingLikeBishop, const int xPosition,
-                         const int yPosition, const OperatingMode mode);
-        
-        inline bool getIsEnemy(const int xPosition, const int yPosition);
-        inline bool getIsEmpty(const int xPosition, const int yPosition);
-        //bool getIsPiece(int xPosition, int yPosition);
-        
-        inline bool getIsKing(const int xPosition, const int yPosition);
-        inline bool getIsQueen(const int xPosition, const int yPosition);
-        inline bool getIsRook(const int xPosition, const int yPosition);
-        inline bool getIsKNight(const int xPosition, const int yPosition);
-        inline bool getIsBishop(const int xPosition, const int yPosition);
-        inline bool getIsPawn(const int xPosition, const int yPosition);
-        
-};
+            xNewPosition = getXPosition(square) + kNightSteps[q][0];
+            yNewPosition = getYPosition(square) + kNightSteps[q][1];
+            if(xNewPosition >= 1 && xNewPosition <= DeskSizeX &&
+               yNewPosition >= 1 && yNewPosition <= DeskSizeY)
+            {
+                kNightAttacks[square] |= getBit(getSquare(xNewPosition, yNewPosition));
+                kNightSquares[square][kNightAmount++] = getSquare(xNewPosition, yNewPosition);
+            }
+            
+            rays[square][q] = 0;
+            xNewPosition = getXPosition(square) + rayDirections[q][0];
+            yNewPosition = getYPosition(square) + rayDirections[q][1];
+            while(xNewPosition >= 1 && xNewPosition <= DeskSizeX &&
+                  yNewPosition >= 1 && yNewPosition <= DeskSizeY)
+            {
+                between[square][getSquare(xNewPosition, yNewPosition)] = rays[square][q];
+                rays[square][q] |= getBit(getSquare(xNewPosition, yNewPosition));
+                xNewPosition += rayDirections[q][0];
+                yNewPosition += rayDirections[q][1];
+            }
+        }
+    }
+    
+    initMagics(rookMagics, rookTable, rookMagicNumbers, true);
+    initMagics(bishopMagics, bishopTable, bishopMagicNumbers, false);
+    
+    return true;
+}
 
-Chess::Chess()
+Chess::HashKey Chess::Zobrist::getNextRandom(HashKey *const state)
+{
+    //генератор xorshift64*
+    *state ^= *state >> 12;
+    *state ^= *state << 25;
+    *state ^= *state >> 27;
+    return *state * 0x2545F4914F6CDD1DULL;
+}
+
+bool Chess::Zobrist::initKeys()
 {
+    //Начальное значение генератора фиксировано,
+    //поэтому ключи позиций одинаковы при каждом запуске
+    HashKey state = 0x9E3779B97F4A7C15ULL;
+    
+    for(int side = 0; side < 2; side++)
+    {
+        for(int pieceType = 0; pieceType <= AmountTypesOfPieces; pieceType++)
+        {
+            for(int square = 0; square < DeskSizeX * DeskSizeY; square++)
+                {pieceKeys[side][pieceType][square] = getNextRandom(&state);}
+        }
+    }
+    blackTurnKey = getNextRandom(&state);
+    
+    //без прав на рокировку ключ нулевой
+    castlingKeys[0] = 0;
+    for(int i = 1; i < 16; i++)
+        {castlingKeys[i] = getNextRandom(&state);}
+    for(int i = 0; i < DeskSizeX; i++)
+        {enPassantKeys[i] = getNextRandom(&state);}
     
+    return true;
 }
 
 Chess::Desk::Desk()
 {
+    clearDesk();
     
+    //при копировании доски емкость сохраняется - ходы не обращаются к куче
+    previousPlys.reserve(MaxPlys);
+}
+
+void Chess::Desk::clearDesk()
+{
     for(int i = 0; i <= DeskSizeX + 1; i++)
     {
         for(int j = 0; j <= DeskSizeY + 1; j++)
@@ -327,16 +371,28 @@ Chess::Desk::Desk()
         desk[i][DeskSizeY + 1] = DeskBorder;
     }
     
-    isWhiteTurn = true;
+    for(int i = 0; i <= AmountTypesOfPieces; i++)
+    {
+        pieces[0][i] = 0;
+        pieces[1][i] = 0;
+    }
+    sidePieces[0] = 0;
+    sidePieces[1] = 0;
+    occupied = 0;
+    hashKey = 0;
     
-    xWhiteKing = 0;
-    yWhiteKing = 0;
-    xBlackKing = 0;
-    yBlackKing = 0;
+    isWhiteTurn = true;
 
     isEnPassantPossible = false;
     xPosMovedPawn = 0;
     yPosMovedPawn = 0;
+    
+    isWhiteShortCPermit = false;
+    isWhiteLongCPermit = false;
+    isBlackShortCPermit = false;
+    isBlackLongCPermit = false;
+    
+    previousPlys.clear();
 }
 
 void Chess::Desk::initDesk()
@@ -354,11 +410,33 @@ void Chess::Desk::initDesk()
     isBlackLongCPermit = (desk[XKingCPosition][YBlackKingCLine] == BlackKing &&
                                  desk[XLeftRookCPosition][YBlackKingCLine] == BlackRook);
     
-    initKingPositions();
+    hashKey = computeHashKey();
     
     //track.reserve(MaxPlys);
 }
 
+Chess::HashKey Chess::Desk::computeHashKey()
+{
+    //Полный пересчет ключа позиции, в ходе игры ключ обновляется пошагово
+    HashKey key = getStateHashKey();
+    if(!isWhiteTurn){key ^= Zobrist::getBlackTurnKey();}
+    
+    BitBoard bitBoard = 0;
+    for(int side = 0; side < 2; side++)
+    {
+        for(int pieceType = WhiteKing; pieceType <= AmountTypesOfPieces; pieceType++)
+        {
+            bitBoard = pieces[side][pieceType];
+            while(bitBoard)
+            {
+                key ^= Zobrist::getPieceKey(side, pieceType,
+                                            BitBoards::popFirstSquare(&bitBoard));
+            }
+        }
+    }
+    return key;
+}
+
 
 bool Chess::Desk:: operator == (const Desk &d1)
 {
@@ -373,6 +451,16 @@ bool Chess::Desk:: operator == (const Desk &d1)
         }
     }
                 
+    for(int i = 0; i <= AmountTypesOfPieces; i++)
+    {
+        if(this->pieces[0][i] != d1.pieces[0][i]){return false;}
+        if(this->pieces[1][i] != d1.pieces[1][i]){return false;}
+    }
+    if(this->sidePieces[0] != d1.sidePieces[0]){return false;}
+    if(this->sidePieces[1] != d1.sidePieces[1]){return false;}
+    if(this->occupied != d1.occupied){return false;}
+    if(this->hashKey != d1.hashKey){return false;}
+    
     if(this->isWhiteTurn != d1.isWhiteTurn){return false;}
                     
     if(this->isWhiteShortCPermit != d1.isWhiteShortCPermit){return false;}
@@ -383,128 +471,142 @@ bool Chess::Desk:: operator == (const Desk &d1)
     if(this->isEnPassantPossible != d1.isEnPassantPossible){return false;}
     if(this->xPosMovedPawn != d1.xPosMovedPawn){return false;}
     if(this->yPosMovedPawn != d1.yPosMovedPawn){return false;}
-                        
-    if(this->xWhiteKing != d1.xWhiteKing){return false;}
-    if(this->yWhiteKing != d1.yWhiteKing){return false;}
-    if(this->xBlackKing != d1.xBlackKing){return false;}
-    if(this->yBlackKing != d1.yBlackKing){return false;}
             
     return true;
 }
 
 
-void Chess::Desk::makeMoveAhead(const ply newMove, const bool isTurnChanging)
+void Chess::Desk::makeMoveAhead(const PackedPly newMove, const bool isTurnChanging)
 {
-    
-    assert(!(!(desk[newMove.xSourceField][newMove.ySourceField] == BlackKing ||
-               desk[newMove.xSourceField][newMove.ySourceField] == WhiteKing) && 
-               newMove.isCastling == true));
-    assert(!((newMove.yDestinationField != YBlackKingCLine &&
-              newMove.yDestinationField != YWhiteKingCLine) &&
-              newMove.isCastling == true));
-    assert(newMove.whichPieceIfTaking != WhiteKing &&
-           newMove.whichPieceIfTaking != BlackKing);
-    assert(newMove.movingPieceType == desk[newMove.xSourceField][newMove.ySourceField]);
-    assert(newMove.movingPieceType != 0);
-    assert(newMove.whichPieceIfPromotion == 0 ||
-          (newMove.whichPieceIfPromotion > 0 &&
-          (newMove.movingPieceType == WhitePawn ||
-           newMove.movingPieceType == BlackPawn)));
-
-    previousPlys.push_back(newMove); 
+    int xSourceField = newMove.getXSourceField();
+    int ySourceField = newMove.getYSourceField();
+    int xDestinationField = newMove.getXDestinationField();
+    int yDestinationField = newMove.getYDestinationField();
+    int movingPieceType = newMove.getMovingPieceType();
+    int whichPieceIfTaking = newMove.getWhichPieceIfTaking();
+    int whichPieceIfPromotion = newMove.getWhichPieceIfPromotion();
+    bool isCastling = newMove.getIsCastling();
+    
+    assert(!(!(desk[xSourceField][ySourceField] == BlackKing ||
+               desk[xSourceField][ySourceField] == WhiteKing) && 
+               isCastling == true));
+    assert(!((yDestinationField != YBlackKingCLine &&
+              yDestinationField != YWhiteKingCLine) &&
+              isCastling == true));
+    assert(whichPieceIfTaking != WhiteKing &&
+           whichPieceIfTaking != BlackKing);
+    assert(movingPieceType == desk[xSourceField][ySourceField]);
+    assert(movingPieceType != 0);
+    assert(whichPieceIfPromotion == 0 ||
+          (whichPieceIfPromotion > 0 &&
+          (movingPieceType == WhitePawn ||
+           movingPieceType == BlackPawn)));
+
+    //Состояние, которое нельзя восстановить по самому полуходу,
+    //сохраняется в истории отдельно
+    plyUndo undo;
+    undo.move = newMove;
+    undo.castlingPermitsPrevious = getCastlingPermits();
+    undo.isEnPassantPossiblePrevious = isEnPassantPossible;
+    undo.xPosMovedPawnPrevious = xPosMovedPawn;
+    undo.yPosMovedPawnPrevious = yPosMovedPawn;
+    undo.hashKeyPrevious = hashKey;
+    previousPlys.push_back(undo);
+    
+    //ключи прав на рокировку и взятия на проходе снимаются здесь
+    //и накладываются заново после хода
+    hashKey ^= getStateHashKey();
     
     //Перемещаем фигуру, очищаем исходное поле
     //превращаем пешку, если требуется
-    desk[newMove.xDestinationField][newMove.yDestinationField]
-      = desk[newMove.xSourceField][newMove.ySourceField];//
-    if(newMove.whichPieceIfPromotion > 0)
+    if(whichPieceIfPromotion > 0)
     {
-        desk[newMove.xDestinationField][newMove.yDestinationField] = newMove.whichPieceIfPromotion;//
+        setField(xDestinationField, yDestinationField,
+                 whichPieceIfPromotion);//
     }
     else
     {
-        desk[newMove.xSourceField][newMove.ySourceField] = Empty;//
+        setField(xDestinationField, yDestinationField,
+                 desk[xSourceField][ySourceField]);//
     }
+    setField(xSourceField, ySourceField, Empty);//
     
-    if(newMove.movingPieceType == BlackKing ||
-       newMove.movingPieceType == WhiteKing)
+    if(movingPieceType == BlackKing ||
+       movingPieceType == WhiteKing)
     {
         if(getIsWhiteTurn())
         {
-            xWhiteKing = newMove.xDestinationField;//
-            yWhiteKing = newMove.yDestinationField;//
-            
             isWhiteShortCPermit = false;//
             isWhiteLongCPermit = false;//
         }
         else
         {
-            xBlackKing = newMove.xDestinationField;//
-            yBlackKing = newMove.yDestinationField;//
-            
             isBlackShortCPermit = false;//
             isBlackLongCPermit = false;//
         }
         
-        if(newMove.isCastling)
+        if(isCastling)
         {
-            moveRookForCastling(newMove.xDestinationField,
-                                newMove.yDestinationField);//
+            moveRookForCastling(xDestinationField,
+                                yDestinationField);//
         }    
     }
 
-    if(newMove.movingPieceType == BlackRook ||
-       newMove.movingPieceType == WhiteRook)
+    if(movingPieceType == BlackRook ||
+       movingPieceType == WhiteRook)
     {
         if(getIsWhiteTurn())
         {
-            if(newMove.xSourceField == XRightRookCPosition)
+            if(xSourceField == XRightRookCPosition &&
+               ySourceField == YWhiteKingCLine)
             {
                 isWhiteShortCPermit = false;//
             }
-            if(newMove.xSourceField == XLeftRookCPosition)
+            if(xSourceField == XLeftRookCPosition &&
+               ySourceField == YWhiteKingCLine)
             {
                 isWhiteLongCPermit = false;//
             }
         }
         else
         {
-            if(newMove.xSourceField == XRightRookCPosition)
+            if(xSourceField == XRightRookCPosition &&
+               ySourceField == YBlackKingCLine)
             {
                 isBlackShortCPermit = false;//
             }
-            if(newMove.xSourceField == XLeftRookCPosition)
+            if(xSourceField == XLeftRookCPosition &&
+               ySourceField == YBlackKingCLine)
             {
                 isBlackLongCPermit = false;//
             }
         }
     }
     
-    if(newMove.movingPieceType == BlackPawn ||
-       newMove.movingPieceType == WhitePawn)
+    //взятая в углу ладья лишает противника права на рокировку в эту сторону
+    if(whichPieceIfTaking == WhiteRook &&
+       yDestinationField == YWhiteKingCLine)
     {
-        if(isEnPassantPossible)
-        {
-            int movingPawnId = 0;
-            int yTakingPawnPos = 0;
-            
-            if(getIsWhiteTurn())
-            {
-                movingPawnId = WhitePawn;
-                yTakingPawnPos = newMove.yDestinationField - 1;
-            }
-            else
-            {
-                movingPawnId = BlackPawn;
-                yTakingPawnPos = newMove.yDestinationField + 1;
-            }
-            if(xPosMovedPawn == newMove.xDestinationField &&
-               yPosMovedPawn == yTakingPawnPos &&
-               newMove.movingPieceType == movingPawnId)
-            {
-                desk[xPosMovedPawn][yPosMovedPawn] = Empty;//
-            }
-        }
+        if(xDestinationField == XRightRookCPosition)
+            {isWhiteShortCPermit = false;}//
+        if(xDestinationField == XLeftRookCPosition)
+            {isWhiteLongCPermit = false;}//
+    }
+    if(whichPieceIfTaking == BlackRook &&
+       yDestinationField == YBlackKingCLine)
+    {
+        if(xDestinationField == XRightRookCPosition)
+            {isBlackShortCPermit = false;}//
+        if(xDestinationField == XLeftRookCPosition)
+            {isBlackLongCPermit = false;}//
+    }
+    
+    if(newMove.getIsEnPassant())
+    {
+        //взятая на проходе пешка стоит рядом с исходным полем
+        assert(isEnPassantPossible &&
+               xPosMovedPawn == xDestinationField && yPosMovedPawn == ySourceField);
+        setField(xPosMovedPawn, yPosMovedPawn, Empty);//
     }
 
 
@@ -512,23 +614,26 @@ void Chess::Desk::makeMoveAhead(const ply newMove, const bool isTurnChanging)
     xPosMovedPawn = 0;//
     yPosMovedPawn = 0;//
     
-    if(newMove.movingPieceType == BlackPawn ||
-       newMove.movingPieceType == WhitePawn)
+    if(movingPieceType == BlackPawn ||
+       movingPieceType == WhitePawn)
     {
-        int differencePosY = newMove.yDestinationField - newMove.ySourceField;
-        if((newMove.movingPieceType == BlackPawn && differencePosY == -2) ||
-           (newMove.movingPieceType == WhitePawn && differencePosY == 2))
+        int differencePosY = yDestinationField - ySourceField;
+        if((movingPieceType == BlackPawn && differencePosY == -2) ||
+           (movingPieceType == WhitePawn && differencePosY == 2))
         {
             isEnPassantPossible = true;//
-            xPosMovedPawn = newMove.xDestinationField;//
-            yPosMovedPawn = newMove.yDestinationField;//
+            xPosMovedPawn = xDestinationField;//
+            yPosMovedPawn = yDestinationField;//
         }
     }
     
+    hashKey ^= getStateHashKey();
+    
     if(isTurnChanging){switchTurn();}
     
-    assert(desk[xBlackKing][yBlackKing] == BlackKing &&
-           desk[xWhiteKing][yWhiteKing] == WhiteKing);
+    assert(__builtin_popcountll(pieces[0][WhiteKing]) == 1 &&
+           __builtin_popcountll(pieces[1][WhiteKing]) == 1);
+    assert(hashKey == computeHashKey());
 
 }
 
@@ -538,89 +643,69 @@ void Chess::Desk::makeMoveBack(const bool isTurnChanging)
     
     if(isTurnChanging){switchTurn();}
     
-    ply newMove = previousPlys.back();
+    plyUndo undo = previousPlys.back();
     previousPlys.pop_back();
     
+    PackedPly newMove = undo.move;
+    int xSourceField = newMove.getXSourceField();
+    int ySourceField = newMove.getYSourceField();
+    int xDestinationField = newMove.getXDestinationField();
+    int yDestinationField = newMove.getYDestinationField();
+    int whichPieceIfTaking = newMove.getWhichPieceIfTaking();
+    int whichPieceIfPromotion = newMove.getWhichPieceIfPromotion();
+    bool isCastling = newMove.getIsCastling();
+    
     //Ходим назад и возвращаем взятую фигуру
-    desk[newMove.xSourceField][newMove.ySourceField]
-      = desk[newMove.xDestinationField][newMove.yDestinationField];//
-    desk[newMove.xDestinationField][newMove.yDestinationField]
-      = newMove.whichPieceIfTaking;//
+    setField(xSourceField, ySourceField,
+             desk[xDestinationField][yDestinationField]);//
+    setField(xDestinationField, yDestinationField,
+             whichPieceIfTaking);//
 
     //Превращаем назад в пешку,
     //если было превращение
-    if(newMove.whichPieceIfPromotion > 0)
+    if(whichPieceIfPromotion > 0)
     {
         if(getIsWhiteTurn())
         {
-            desk[newMove.xSourceField][newMove.ySourceField]
-              = WhitePawn;//
+            setField(xSourceField, ySourceField, WhitePawn);//
         }
         else
         {
-            desk[newMove.xSourceField][newMove.ySourceField]
-              = BlackPawn;//
+            setField(xSourceField, ySourceField, BlackPawn);//
         }
     }
 
 
-    if(newMove.movingPieceType == BlackKing ||
-       newMove.movingPieceType == WhiteKing)
+    if(isCastling)
     {
-        //printf("MB ");
-        if(getIsWhiteTurn())
-        {xWhiteKing = newMove.xSourceField; yWhiteKing = newMove.ySourceField;}//
-        else
-        {xBlackKing = newMove.xSourceField; yBlackKing = newMove.ySourceField;}//
-        
-        if(newMove.isCastling)
-        {
-            moveRookForCastling(newMove.xDestinationField,
-                                newMove.yDestinationField);//
-        }
+        moveRookForCastling(xDestinationField,
+                            yDestinationField);//
     }
     
     
-    if(newMove.whichPieceIfTaking == BlackPawn ||
-       newMove.whichPieceIfTaking == WhitePawn)
+    if(newMove.getIsEnPassant())
     {
-        if(newMove.isEnPassantPossiblePrevious)
-        {        
-                int movingPawnId = 0;
-                int yTakingPawnPos = 0;
-                
-                if(getIsWhiteTurn())
-                {
-                    movingPawnId = WhitePawn;
-                    yTakingPawnPos = newMove.yDestinationField - 1;
-                }
-                else
-                {
-                    movingPawnId = BlackPawn;
-                    yTakingPawnPos = newMove.yDestinationField + 1;
-                }
-                
-                if(newMove.xPosMovedPawnPrevious == newMove.xDestinationField &&
-                   newMove.yPosMovedPawnPrevious == (yTakingPawnPos) &&
-                   desk[newMove.xSourceField][newMove.ySourceField] == movingPawnId)
-                {
-                    desk[newMove.xPosMovedPawnPrevious][newMove.yPosMovedPawnPrevious] = newMove.whichPieceIfTaking;//
-                    desk[newMove.xDestinationField][newMove.yDestinationField] = Empty;//
-                }
-        }
+        //пешка, взятая на проходе, возвращается на своё поле
+        setField(undo.xPosMovedPawnPrevious, undo.yPosMovedPawnPrevious,
+                 whichPieceIfTaking);//
+        setField(xDestinationField, yDestinationField, Empty);//
     }
     
-    isWhiteShortCPermit = newMove.isWhiteShortCPermitPrevious;
-    isWhiteLongCPermit = newMove.isWhiteLongCPermitPrevious;
-    isBlackShortCPermit = newMove.isBlackShortCPermitPrevious;
-    isBlackLongCPermit = newMove.isBlackLongCPermitPrevious;
+    isWhiteShortCPermit = (undo.castlingPermitsPrevious & 1) != 0;
+    isWhiteLongCPermit = (undo.castlingPermitsPrevious & 2) != 0;
+    isBlackShortCPermit = (undo.castlingPermitsPrevious & 4) != 0;
+    isBlackLongCPermit = (undo.castlingPermitsPrevious & 8) != 0;
+    
+    isEnPassantPossible = undo.isEnPassantPossiblePrevious;
+    xPosMovedPawn = undo.xPosMovedPawnPrevious;
+    yPosMovedPawn = undo.yPosMovedPawnPrevious;
     
-    isEnPassantPossible = newMove.isEnPassantPossiblePrevious;
-    xPosMovedPawn = newMove.xPosMovedPawnPrevious;
-    yPosMovedPawn = newMove.yPosMovedPawnPrevious;
+    //ключ восстанавливается из истории целиком
+    hashKey = undo.hashKeyPrevious;
     
-    assert(desk[xBlackKing][yBlackKing] == BlackKing &&
-           desk[xWhiteKing][yWhiteKing] == WhiteKing);
+    assert(hashKey == computeHashKey());
+    assert(__builtin_popcountll(pieces[0][WhiteKing]) == 1 &&
+           __builtin_popcountll(pieces[1][WhiteKing]) == 1);
 
 }
 
@@ -645,8 +730,9 @@ inline void Chess::Desk::moveRookForCastling(const int xKingDestinationField,
     }
     
     buff = desk[XRookCPosition][yKingDestinationField];//
-    desk[XRookCPosition][yKingDestinationField] = desk[XRookCNewPos][yKingDestinationField];//
-    desk[XRookCNewPos][yKingDestinationField] = buff;//
+    setField(XRookCPosition, yKingDestinationField,
+             desk[XRookCNewPos][yKingDestinationField]);//
+    setField(XRookCNewPos, yKingDestinationField, buff);//
 }
 
 char Chess::getPieceSymbol(const int pieceID)
@@ -678,7 +764,7 @@ char Chess::getPieceSymbol(const int pieceID)
     
 }
 
-char getXPositionSymbol(int xPosition)
+char getXPositionSymbol(const int xPosition)
 {
     assert(xPosition <= 26);
     
@@ -699,6 +785,10 @@ void Chess::printDesk(const bool isPreviousPositionShow,
             {
                 printf(" %c", '*');
             }
+            else if(isColorsSwapped && j >= 1 && j <= DeskSizeY)
+            {
+                printf(" %c", getPieceSymbol(getSwappedPieceType(desk.getField(i, DeskSizeY - j + 1))));
+            }
             else
             {
                 printf(" %c", getPieceSymbol(desk.getField(i,j)));
@@ -732,106 +822,77 @@ void Chess::printDesk(const bool isPreviousPositionShow,
 
 void Chess::printTesting()
 {
-    std::list<ply>::iterator i = testing.begin();
+    std::list<PackedPly>::iterator i = testing.begin();
      
     if (!testing.empty())
         for (i; i != testing.end(); ++i)
             printf("%d %d %d %d %d\t %d %d\n",
-                   i->xSourceField, i->ySourceField,
-                   i->xDestinationField, i->yDestinationField,
-                   i->whichPieceIfTaking,
-                   i->isCastling, i->whichPieceIfPromotion);
+                   i->getXSourceField(), i->getYSourceField(),
+                   i->getXDestinationField(), i->getYDestinationField(),
+                   i->getWhichPieceIfTaking(),
+                   (int)i->getIsCastling(), i->getWhichPieceIfPromotion());
 }
 
-void Chess::Desk::initKingPositions()
+bool Chess::getIsFieldUnderAttack(const int xPosition, const int yPosition)
 {
-    for(int i = 1; i <= DeskSizeX; i++)
-    {
-        for(int j = 1; j <= DeskSizeY; j++)
-        {
-            if(desk[i][j] == WhiteKing)
-            {
-                xWhiteKing = i;
-                yWhiteKing = j;
-            }
-            else
-            {
-                if(desk[i][j] == BlackKing)
-                {
-                    xBlackKing = i;
-                    yBlackKing = j;
-                }
-            }
-        }
-    }
+    //Бьёт ли поле сторона, которая сейчас не ходит
+    return getIsFieldUnderAttack(BitBoards::getSquare(xPosition, yPosition),
+                                 !desk.getIsWhiteTurn(), desk.getOccupied());
 }
 
-
-bool Chess::getIsFieldUnderAttack(const int xPosition, const int yPosition)
+bool Chess::getIsFieldUnderAttack(const int square, const bool isByWhite,
+                                  const BitBoard occupied)
 {
-    
-    if(generateKing(NULL, xPosition, yPosition, CheckTest))
-        return true;
-    if(generateQueen(NULL, xPosition, yPosition, CheckTest))
+    //Обратная проверка: атаки строятся от самого поля, и на них ищутся
+    //фигуры противника соответствующего типа. Лучи ферзя совпадают с лучами
+    //ладьи и слона, поэтому ферзь проверяется вместе с ними.
+    if(BitBoards::getKNightAttacks(square) & desk.getPieces(isByWhite, WhiteKNight))
         return true;
-    if(generateRook(NULL, xPosition, yPosition, CheckTest))
+    if(BitBoards::getPawnAttacks(!isByWhite, square) & desk.getPieces(isByWhite, WhitePawn))
         return true;
-    if(generateKNight(NULL, xPosition, yPosition, CheckTest))
+    if(BitBoards::getKingAttacks(square) & desk.getPieces(isByWhite, WhiteKing))
         return true;
-    if(generateBishop(NULL, xPosition, yPosition, CheckTest))
+    
+    BitBoard queens = desk.getPieces(isByWhite, WhiteQueen);
+    if(BitBoards::getBishopAttacks(square, occupied) &
+       (desk.getPieces(isByWhite, WhiteBishop) | queens))
         return true;
-    if(generatePawn(NULL, xPosition, yPosition, CheckTest))
+    if(BitBoards::getRookAttacks(square, occupied) &
+       (desk.getPieces(isByWhite, WhiteRook) | queens))
         return true;
     
     return false;
 }
 
-void Chess::addMove(std::queue<ply> *plys, const OperatingMode mode,
-                    const int xSourceField, const int ySourceField,
-                    const int xDestinationField, const int yDestinationField,
-                    const int whichPieceIfTaking,
-                    const int isCastling, const int whichPieceIfPromotion)
+Chess::PackedPly Chess::makePly(const int xSourceField, const int ySourceField,
+                                const int xDestinationField, const int yDestinationField,
+                                const int whichPieceIfTaking,
+                                const int isCastling, const int whichPieceIfPromotion,
+                                const bool isEnPassant)
 {
-    assert(plys != NULL);
     assert(xSourceField <= DeskSizeX &&
            ySourceField <= DeskSizeY &&
            xSourceField > 0 && ySourceField > 0);
     assert(xDestinationField <= DeskSizeX && yDestinationField <= DeskSizeY &&
            xDestinationField > 0 && yDestinationField > 0);
-    assert(mode == Generator || mode == FinalPly);
-           
-    //if(whichPieceIfTaking == WhiteKing || whichPieceIfTaking == BlackKing) 
-        //printDesk(false, 0, 0);
-            
     assert(!(!(getIsKing(xSourceField, ySourceField)) && 
                isCastling == true));
-               
     assert(whichPieceIfTaking != WhiteKing && whichPieceIfTaking != BlackKing); 
     
-    
+    return PackedPly(BitBoards::getSquare(xSourceField, ySourceField),
+                     BitBoards::getSquare(xDestinationField, yDestinationField),
+                     desk.getField(xSourceField, ySourceField),
+                     whichPieceIfTaking, isCastling, whichPieceIfPromotion, isEnPassant);
+}
+
+bool Chess::getIsPlyLegal(const PackedPly newMove)
+{
+    //Проверка полухода ходом вперед и назад. Используется только там,
+    //где маски шахов и связок не дают ответа (взятие на проходе)
+    bool isLegal = false;
     int xKingPosition;
     int yKingPosition;
     
-    ply newMove;
-    newMove.plyNo = plys->size();
-    newMove.movingPieceType = desk.getField(xSourceField, ySourceField);
-    newMove.xSourceField = xSourceField;
-    newMove.ySourceField = ySourceField;
-    newMove.xDestinationField = xDestinationField;
-    newMove.yDestinationField = yDestinationField;
-    newMove.whichPieceIfTaking = whichPieceIfTaking;
-    newMove.isCastling = isCastling;
-    newMove.whichPieceIfPromotion = whichPieceIfPromotion;
-    
-    newMove.isWhiteShortCPermitPrevious = desk.getIsWhiteShortCPermit();
-    newMove.isWhiteLongCPermitPrevious = desk.getIsWhiteLongCPermit();
-    newMove.isBlackShortCPermitPrevious = desk.getIsBlackShortCPermit();
-    newMove.isBlackLongCPermitPrevious = desk.getIsBlackLongCPermit();
-    
-    newMove.isEnPassantPossiblePrevious = desk.getIsEnPassantPossible();
-    newMove.xPosMovedPawnPrevious = desk.getXPosMovedPawn();
-    newMove.yPosMovedPawnPrevious = desk.getYPosMovedPawn();
-        
     #ifndef NDEBUG
         //Копируется состояние доски
         //для тестирования функции возврата хода
@@ -852,19 +913,8 @@ void Chess::addMove(std::queue<ply> *plys, const OperatingMode mode,
         yKingPosition = desk.getYBlackKingPosition();
     }
     
-    if(getIsFieldUnderAttack(xKingPosition, yKingPosition) == false)
-    {
-        #ifndef NDEBUG
-            //вохранение сгенерированных ходов для проверки
-            //правильности прохождения тестов
-            if(testing.size() < 300){testing.push_back(newMove);}
-        #endif
-        
-        plys->push(newMove);
-        //printDesk(true, xSourceField, ySourceField);
-    }
+    isLegal = !getIsFieldUnderAttack(xKingPosition, yKingPosition);
     
-    //printDesk(true, xSourceField, ySourceField);
     desk.makeMoveBack(false);
     
     #ifndef NDEBUG
@@ -874,108 +924,520 @@ void Chess::addMove(std::queue<ply> *plys, const OperatingMode mode,
         delete oldDesk;
     #endif
     
-    //printf("MOVEBACK\n");
+    return isLegal;
 }
 
-void Chess::generateAllPlys(std::queue<ply> *plys, const OperatingMode mode)
+void Chess::addMove(PlyList *plys, const OperatingMode mode,
+                    const int xSourceField, const int ySourceField,
+                    const int xDestinationField, const int yDestinationField,
+                    const int whichPieceIfTaking,
+                    const int isCastling, const int whichPieceIfPromotion)
 {
-    assert(mode != CheckTest);
-    
-    int pieceID = 0;
-    
-    for(int j = DeskSizeY; j >= 1; j--)
-    {
-        for(int i = 1; i <= DeskSizeX; i++)
-        {
-            pieceID = desk.getField(i, j);
-            if(pieceID > 0)
-            {
-                if((desk.getIsWhiteTurn() &&
-                    (pieceID >= WhiteKing) && (pieceID <= AmountTypesOfPieces)) ||
-                   (!desk.getIsWhiteTurn() &&
-                    (pieceID >= BlackKing) && (pieceID <= (BlackIdSum + AmountTypesOfPieces))))
-                {
-                    switch(pieceID)
-                    {
-                        case WhiteKing :{generateKing(plys, i, j, mode); break;}
-                        case WhiteQueen :{generateQueen(plys, i, j, mode); break;}
-                        case WhiteRook :{generateRook(plys, i, j, mode); break;}
-                        case WhiteKNight :{generateKNight(plys, i, j, mode); break;}
-                        case WhiteBishop :{generateBishop(plys, i, j, mode); break;}
-                        case WhitePawn :{generatePawn(plys, i, j, mode); break;}
-        
-                        case BlackKing:{generateKing(plys, i, j, mode); break;}
-                        case BlackQueen:{generateQueen(plys, i, j, mode); break;}
-                        case BlackRook:{generateRook(plys, i, j, mode); break;}
-                        case BlackKNight:{generateKNight(plys, i, j, mode); break;}
-                        case BlackBishop:{generateBishop(plys, i, j, mode); break;}
-                        case BlackPawn:{generatePawn(plys, i, j, mode); break;}
-                    }
-                    if(mode == FinalPly)
-                    {
-                        if(plys->size() > 0)
-                        {
-                            return;
-                        }
-                    }
-                }
-            }
-        }
-    }
+    addMove(plys, mode, makePly(xSourceField, ySourceField,
+                                xDestinationField, yDestinationField,
+                                whichPieceIfTaking, isCastling, whichPieceIfPromotion,
+                                false));
 }
 
-void Chess::computeTest()
+void Chess::addMove(PlyList *plys, const OperatingMode mode, const PackedPly newMove)
 {
-    //std::queue<ply> *plys;
-    //plys = new std::queue<ply>;
-    std::queue<ply> plys;
+    //Полуход уже проверен генератором по маскам шахов и связок,
+    //здесь он только добавляется в список
+    assert(plys != NULL);
+    assert(mode == Generator || mode == FinalPly || mode == CheckingPly);
+    assert(getIsPlyLegal(newMove));
     
-    #ifndef NDEBUG
-        //Копируется состояние доски
-        //для тестирования функции возврата хода
-        Desk* oldDesk = new Desk;
-        *oldDesk = desk;
-    #endif
+    if(mode == CheckingPly && !getIsCheckingPly(newMove)){return;}
     
-    generateAllPlys(&plys, Generator);
-
     #ifndef NDEBUG
-        //Сравнение копии состояния поля до хода
-        //с состоянием на доске после возврата хода
-        assert(desk == *oldDesk);
-        delete oldDesk;
+        //вохранение сгенерированных ходов для проверки
+        //правильности прохождения тестов
+        if(testing.size() < 300){testing.push_back(newMove);}
     #endif
     
-    //printf("SIZE %d\n", plys.size());
-    
-    std::queue<ply> empty;
-    std::swap( plys, empty );
-    //delete plys;
+    plys->push(newMove);
 }
 
-bool Chess::computeResolutionRecursion(const int nPlysRest, const ply *const childPly, 
-                                       std::queue< std::list<ply> > *const childSolutions)
+void Chess::initCheckingMasks()
 {
-    //bool isRootPly,
-    //в функцию передаются childPly и childSolutions,
-    //но (по внутренней логики функции) они воспринимаются
-    //скорее как parentPly и parentSolutions.
-    //Потому, что данная функцция вызывается рекурсивно.
+    //Поля, с которых фигуры стороны, делающей ход, шахуют короля противника,
+    //и фигуры, уход которых с линии открывает шах
+    bool isWhite = desk.getIsWhiteTurn();
+    BitBoard occupied = desk.getOccupied();
+    BitBoard ownPieces = desk.getSidePieces(isWhite);
+    int kingSquare = desk.getKingSquare(!isWhite);
+    checking.enemyKingSquare = kingSquare;
+    
+    checking.checkFields[Empty] = 0;
+    checking.checkFields[WhiteKing] = 0;
+    checking.checkFields[WhitePawn] = BitBoards::getPawnAttacks(!isWhite, kingSquare);
+    checking.checkFields[WhiteKNight] = BitBoards::getKNightAttacks(kingSquare);
+    checking.checkFields[WhiteBishop] = BitBoards::getBishopAttacks(kingSquare, occupied);
+    checking.checkFields[WhiteRook] = BitBoards::getRookAttacks(kingSquare, occupied);
+    checking.checkFields[WhiteQueen] = checking.checkFields[WhiteBishop] |
+                                       checking.checkFields[WhiteRook];
+    
+    checking.discoverers = 0;
+    BitBoard sliders = (BitBoards::getRookAttacks(kingSquare, 0) &
+                        (desk.getPieces(isWhite, WhiteRook) | desk.getPieces(isWhite, WhiteQueen))) |
+                       (BitBoards::getBishopAttacks(kingSquare, 0) &
+                        (desk.getPieces(isWhite, WhiteBishop) | desk.getPieces(isWhite, WhiteQueen)));
+    while(sliders != 0)
+    {
+        BitBoard blockers = BitBoards::getBetween(kingSquare, BitBoards::popFirstSquare(&sliders)) &
+                            occupied;
+        if(blockers != 0 && (blockers & (blockers - 1)) == 0 && (blockers & ownPieces))
+            {checking.discoverers |= blockers;}
+    }
+}
+
+bool Chess::getIsCheckingPly(const PackedPly newMove)
+{
+    //Объявляет ли полуход шах (маски checking должны быть рассчитаны)
+    if(newMove.getIsCastling() || newMove.getIsEnPassant())
+    {
+        //редкие ходы, меняющие сразу два поля, проверяются ходом вперед и назад
+        desk.makeMoveAhead(newMove, true);
+        bool isCheck = getIsFieldUnderAttack(BitBoards::getXPosition(checking.enemyKingSquare),
+                                             BitBoards::getYPosition(checking.enemyKingSquare));
+        desk.makeMoveBack(true);
+        return isCheck;
+    }
+    
+    int sourceSquare = newMove.getSourceSquare();
+    int destinationSquare = newMove.getDestinationSquare();
+    int kingSquare = checking.enemyKingSquare;
+    
+    if(newMove.getWhichPieceIfPromotion() != Empty)
+    {
+        //превращенная фигура бьет и через освободившееся поле пешки
+        BitBoard occupied = (desk.getOccupied() & ~BitBoards::getBit(sourceSquare)) |
+                            BitBoards::getBit(destinationSquare);
+        BitBoard attacks = 0;
+        switch(Desk::getBaseType(newMove.getWhichPieceIfPromotion()))
+        {
+            case WhiteQueen :{attacks = BitBoards::getQueenAttacks(destinationSquare, occupied); break;}
+            case WhiteRook :{attacks = BitBoards::getRookAttacks(destinationSquare, occupied); break;}
+            case WhiteBishop :{attacks = BitBoards::getBishopAttacks(destinationSquare, occupied); break;}
+            case WhiteKNight :{attacks = BitBoards::getKNightAttacks(destinationSquare); break;}
+        }
+        if(attacks & BitBoards::getBit(kingSquare)){return true;}
+    }
+    else
+    {
+        if(checking.checkFields[Desk::getBaseType(newMove.getMovingPieceType())] &
+           BitBoards::getBit(destinationSquare))
+            {return true;}
+    }
+    
+    if(checking.discoverers & BitBoards::getBit(sourceSquare))
+    {
+        //шах открывается, если фигура уходит с луча от короля
+        for(int q = 0; q <= 7; q++)
+        {
+            if(BitBoards::getRay(kingSquare, q) & BitBoards::getBit(sourceSquare))
+                {return (BitBoards::getRay(kingSquare, q) & BitBoards::getBit(destinationSquare)) == 0;}
+        }
+    }
+    
+    return false;
+}
+
+void Chess::orderPlys(PlyList *plys)
+{
+    //Сначала шахи, затем взятия, затем остальные полуходы,
+    //внутри каждой группы сохраняется порядок генерации
+    PlyList checks;
+    PlyList captures;
+    PlyList others;
+    PackedPly newMove;
+    
+    initCheckingMasks();
+    while(!plys->empty())
+    {
+        newMove = plys->front();
+        plys->pop();
+        
+        if(getIsCheckingPly(newMove)){checks.push(newMove);}
+        else if(newMove.getWhichPieceIfTaking() != Empty){captures.push(newMove);}
+        else{others.push(newMove);}
+    }
+    
+    plys->clear();
+    while(!checks.empty()){plys->push(checks.front()); checks.pop();}
+    while(!captures.empty()){plys->push(captures.front()); captures.pop();}
+    while(!others.empty()){plys->push(others.front()); others.pop();}
+}
+
+void Chess::initLegalityMasks()
+{
+    //Шахующие фигуры, связки и маска полей, закрывающих от шаха.
+    //Связанная фигура может ходить только вдоль линии связки,
+    //при двойном шахе ходит только король.
+    bool isWhite = desk.getIsWhiteTurn();
+    BitBoard ownPieces = desk.getSidePieces(isWhite);
+    BitBoard enemyPieces = desk.getSidePieces(!isWhite);
+    BitBoard enemyRooks = desk.getPieces(!isWhite, WhiteRook) |
+                          desk.getPieces(!isWhite, WhiteQueen);
+    BitBoard enemyBishops = desk.getPieces(!isWhite, WhiteBishop) |
+                            desk.getPieces(!isWhite, WhiteQueen);
+    
+    legality.kingSquare = desk.getKingSquare(isWhite);
+    int kingSquare = legality.kingSquare;
+    
+    legality.checkers =
+        (BitBoards::getKNightAttacks(kingSquare) & desk.getPieces(!isWhite, WhiteKNight)) |
+        (BitBoards::getPawnAttacks(isWhite, kingSquare) & desk.getPieces(!isWhite, WhitePawn));
+    legality.pinned = 0;
+    legality.isKingDangerReady = false;
+    
+    //дальнобойные фигуры противника, видящие короля сквозь свои фигуры
+    BitBoard snipers =
+        (BitBoards::getRookAttacks(kingSquare, enemyPieces) & enemyRooks) |
+        (BitBoards::getBishopAttacks(kingSquare, enemyPieces) & enemyBishops);
+    while(snipers != 0)
+    {
+        int sniperSquare = BitBoards::popFirstSquare(&snipers);
+        BitBoard blockers = BitBoards::getBetween(kingSquare, sniperSquare) & ownPieces;
+        
+        if(blockers == 0)
+        {
+            legality.checkers |= BitBoards::getBit(sniperSquare);
+        }
+        else
+        {
+            if((blockers & (blockers - 1)) == 0)
+            {
+                legality.pinned |= blockers;
+                legality.pinLines[__builtin_ctzll(blockers)] =
+                    BitBoards::getBetween(kingSquare, sniperSquare) |
+                    BitBoards::getBit(sniperSquare);
+            }
+        }
+    }
+    
+    if(legality.checkers == 0)
+    {
+        legality.checkMask = ~0ULL;
+    }
+    else
+    {
+        if((legality.checkers & (legality.checkers - 1)) == 0)
+        {
+            legality.checkMask = legality.checkers |
+                BitBoards::getBetween(kingSquare, __builtin_ctzll(legality.checkers));
+        }
+        else
+        {
+            legality.checkMask = 0;
+        }
+    }
+}
+
+Chess::BitBoard Chess::getKingDanger()
+{
+    //Поля, которые бьет противник. Король снимается с доски,
+    //чтобы он не мог отступить вдоль линии шаха дальнобойной фигуры.
+    if(legality.isKingDangerReady){return legality.kingDanger;}
+    
+    bool isWhite = desk.getIsWhiteTurn();
+    BitBoard occupied = desk.getOccupied() & ~BitBoards::getBit(legality.kingSquare);
+    BitBoard danger = 0;
+    BitBoard enemyPieces = 0;
+    
+    enemyPieces = desk.getPieces(!isWhite, WhitePawn);
+    while(enemyPieces != 0)
+    {
+        danger |= BitBoards::getPawnAttacks(!isWhite,
+                                            BitBoards::popFirstSquare(&enemyPieces));
+    }
+    enemyPieces = desk.getPieces(!isWhite, WhiteKNight);
+    while(enemyPieces != 0)
+    {
+        danger |= BitBoards::getKNightAttacks(BitBoards::popFirstSquare(&enemyPieces));
+    }
+    enemyPieces = desk.getPieces(!isWhite, WhiteBishop) |
+                  desk.getPieces(!isWhite, WhiteQueen);
+    while(enemyPieces != 0)
+    {
+        danger |= BitBoards::getBishopAttacks(BitBoards::popFirstSquare(&enemyPieces),
+                                              occupied);
+    }
+    enemyPieces = desk.getPieces(!isWhite, WhiteRook) |
+                  desk.getPieces(!isWhite, WhiteQueen);
+    while(enemyPieces != 0)
+    {
+        danger |= BitBoards::getRookAttacks(BitBoards::popFirstSquare(&enemyPieces),
+                                            occupied);
+    }
+    danger |= BitBoards::getKingAttacks(desk.getKingSquare(!isWhite));
+    
+    legality.kingDanger = danger;
+    legality.isKingDangerReady = true;
+    
+    return danger;
+}
+
+void Chess::generateAllPlys(PlyList *plys, const OperatingMode mode)
+{
+    //Генерируются только легальные полуходы
+    if(mode == CheckingPly){initCheckingMasks();}
+    
+    if(desk.getIsWhiteTurn())
+    {
+        switch(mode)
+        {
+            case Generator :{generateAllPlys<true, Generator>(plys); break;}
+            case FinalPly :{generateAllPlys<true, FinalPly>(plys); break;}
+            case CheckingPly :{generateAllPlys<true, CheckingPly>(plys); break;}
+        }
+    }
+    else
+    {
+        switch(mode)
+        {
+            case Generator :{generateAllPlys<false, Generator>(plys); break;}
+            case FinalPly :{generateAllPlys<false, FinalPly>(plys); break;}
+            case CheckingPly :{generateAllPlys<false, CheckingPly>(plys); break;}
+        }
+    }
+}
+
+template<bool isWhite, Chess::OperatingMode mode>
+void Chess::generateAllPlys(PlyList *plys)
+{
+    assert(isWhite == desk.getIsWhiteTurn());
+    
+    int pieceID = 0;
+    int square = 0;
+    int x = 0;
+    int y = 0;
+    BitBoard rankPieces = 0;
+    
+    initLegalityMasks();
+    
+    //Обход только имеющихся фигур стороны, делающей ход, в прежнем порядке:
+    //горизонтали с восьмой по первую, внутри горизонтали слева направо
+    for(int j = DeskSizeY; j >= 1; j--)
+    {
+        rankPieces = desk.getSidePieces(isWhite) &
+                     (0xFFULL << ((j - 1) * DeskSizeX));
+        while(rankPieces)
+        {
+            square = BitBoards::popFirstSquare(&rankPieces);
+            x = BitBoards::getXPosition(square);
+            y = BitBoards::getYPosition(square);
+            pieceID = desk.getField(x, y);
+            
+            switch(Desk::getBaseType(pieceID))
+            {
+                case WhiteKing :{generateKing<isWhite, mode>(plys, x, y); break;}
+                case WhiteQueen :{generateQueen<isWhite, mode>(plys, x, y); break;}
+                case WhiteRook :{generateRook<isWhite, mode>(plys, x, y); break;}
+                case WhiteKNight :{generateKNight<isWhite, mode>(plys, x, y); break;}
+                case WhiteBishop :{generateBishop<isWhite, mode>(plys, x, y); break;}
+                case WhitePawn :{generatePawn<isWhite, mode>(plys, x, y); break;}
+            }
+            if(mode == FinalPly)
+            {
+                if(plys->size() > 0)
+                {
+                    return;
+                }
+            }
+        }
+    }
+}
+
+void Chess::computeTest()
+{
+    PlyList plys;
+    
+    #ifndef NDEBUG
+        //Копируется состояние доски
+        //для тестирования функции возврата хода
+        Desk* oldDesk = new Desk;
+        *oldDesk = desk;
+    #endif
+    
+    generateAllPlys(&plys, Generator);
+
+    #ifndef NDEBUG
+        //Сравнение копии состояния поля до хода
+        //с состоянием на доске после возврата хода
+        assert(desk == *oldDesk);
+        delete oldDesk;
+    #endif
+    
+    //printf("SIZE %d\n", plys.size());
+}
+
+unsigned long long Chess::perft(const int depth)
+{
+    assert(depth >= 0);
+    if(depth == 0){return 1;}
+    
+    PlyList plys;
+    generateAllPlys(&plys, Generator);
+    
+    //генерируются только легальные полуходы,
+    //поэтому на последнем уровне ходы не делаются
+    if(depth == 1){return plys.size();}
+    
+    unsigned long long nodes = 0;
+    while(!plys.empty())
+    {
+        desk.makeMoveAhead(plys.front(), true);
+        nodes += perft(depth - 1);
+        desk.makeMoveBack(true);
+        plys.pop();
+    }
+    return nodes;
+}
+
+unsigned long long Chess::perftDivide(const int depth)
+{
+    assert(depth >= 1);
+    
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    
+    PlyList plys;
+    generateAllPlys(&plys, Generator);
+    
+    unsigned long long nodes = 0;
+    unsigned long long moveNodes = 0;
+    PackedPly newMove;
+    while(!plys.empty())
+    {
+        newMove = plys.front();
+        plys.pop();
+        
+        desk.makeMoveAhead(newMove, true);
+        moveNodes = perft(depth - 1);
+        desk.makeMoveBack(true);
+        nodes += moveNodes;
+        
+        plyForOut plyOuter = getPlyForOut(newMove, 0);
+        printf("  %s", getPlyText(plyOuter).c_str());
+        if(plyOuter.whichPieceIfPromotion != Empty)
+            {printf("=%c", getPieceSymbol(plyOuter.whichPieceIfPromotion));}
+        printf(": %llu\n", moveNodes);
+    }
+    
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() -
+                                                   start).count();
+    printf("\nperft(%d) = %llu\n", depth, nodes);
+    printf("time: %.3f s, %.0f nodes/s\n", seconds,
+           (seconds > 0) ? (nodes / seconds) : 0.0);
+    
+    return nodes;
+}
+
+void Chess::clearRefutations()
+{
+    for(int i = 0; i < MaxPlys; i++)
+    {
+        for(int j = 0; j < KillersAmount; j++){killers[i][j] = PackedPly();}
+    }
+    memset(refutationHistory, 0, sizeof(refutationHistory));
+}
+
+void Chess::noteRefutation(const int nPlysRest, const PackedPly refutation)
+{
+    assert(nPlysRest > 0 && nPlysRest < MaxPlys);
+    
+    if(killers[nPlysRest][0] != refutation)
+    {
+        for(int j = KillersAmount - 1; j > 0; j--){killers[nPlysRest][j] = killers[nPlysRest][j - 1];}
+        killers[nPlysRest][0] = refutation;
+    }
+    
+    //опровержение с большим запасом полуходов отсекает большее поддерево
+    unsigned int *counter = &refutationHistory[refutation.getSourceSquare()]
+                                              [refutation.getDestinationSquare()];
+    *counter += nPlysRest * nPlysRest;
+    if(*counter > (1U << 30))
+    {
+        //старая статистика постепенно забывается
+        for(int i = 0; i < DeskSizeX * DeskSizeY; i++)
+        {
+            for(int j = 0; j < DeskSizeX * DeskSizeY; j++){refutationHistory[i][j] /= 2;}
+        }
+    }
+}
+
+Chess::PackedPly Chess::getBestHistoryPly(PlyList *plys)
+{
+    //полуход с наибольшим счетчиком опровержений (пустой, если счетчики нулевые)
+    PackedPly bestPly;
+    unsigned int bestCounter = 0;
+    for(int i = 0; i < plys->size(); i++)
+    {
+        PackedPly newMove = plys->at(i);
+        unsigned int counter = refutationHistory[newMove.getSourceSquare()]
+                                                [newMove.getDestinationSquare()];
+        if(counter > bestCounter)
+        {
+            bestCounter = counter;
+            bestPly = newMove;
+        }
+    }
+    return bestPly;
+}
+
+bool Chess::computeResolutionRecursion(const int nPlysRest, int *const solutionsTree)
+{
+    //Если мат доказан, в solutionsTree возвращается первый из цепочки
+    //узлов дерева решений - продолжений из текущей позиции
+    //(NoSolutionNode, если черным уже мат). Узлы, выделенные при
+    //переборе опровергнутой позиции, освобождаются (откат solutionNodes).
     
     assert(false == ((nPlysRest == 0) && desk.getIsWhiteTurn()));
-    assert(nPlysRest >= 0);
-    assert(childSolutions != 0);
-    //assert(childPly->plyNo >= -1 && childPly->plyNo  < 300);
+    assert(nPlysRest >= 0 && nPlysRest < MaxPlys);
+    assert(solutionsTree != 0);
     //printf("%d ", nPlysRest);
     
-    std::queue< std::list<ply> > solutions;
-    std::list<ply> path; 
-    std::queue<ply> plys;
+    nodesAmount++;
+    const int solutionsMark = (int)solutionNodes.size();
+    int solutions = NoSolutionNode;
+    PlyList plys;
     
-    ply newMove;
+    PackedPly newMove;
     int plyNo = 0;
     //std::list<int> path1;
     
+    //Опровергнутая ранее позиция (с не меньшим запасом полуходов) решений не содержит.
+    //Для доказанной позиции белых с тем же запасом известен первый
+    //доказывающий ход: предшествующие ему ходы перебирать не нужно,
+    //набор путей от этого не меняется.
+    TranspositionTable::entry storedEntry;
+    const TranspositionTable::entry *stored = NULL;
+    bool isFirstProvingPlyKnown = false;
+    PackedPly firstProvingPly;
+    bool isOrderingPlyKnown = false;
+    PackedPly orderingPly;
+    if(nPlysRest > 0)
+    {
+        if(transpositions.probe(desk.getHashKey(), &storedEntry)){stored = &storedEntry;}
+        if(stored != NULL)
+        {
+            if(stored->bound == TranspositionTable::Refuted && stored->depth >= nPlysRest)
+                {return false;}
+            if(stored->bound == TranspositionTable::Proven && stored->depth == nPlysRest &&
+               desk.getIsWhiteTurn())
+            {
+                isFirstProvingPlyKnown = true;
+                firstProvingPly = stored->bestMove;
+            }
+            if(stored->bound == TranspositionTable::Proven && stored->depth < nPlysRest &&
+               desk.getIsWhiteTurn() && isShortestMateSearch)
+            {
+                orderingPly = stored->bestMove;
+                isOrderingPlyKnown = true;
+            }
+        }
+    }
+    
     #ifndef NDEBUG
         //Копируется состояние доски
         //для тестирования функции возврата хода
@@ -983,10 +1445,27 @@ bool Chess::computeResolutionRecursion(const int nPlysRest, const ply *const chi
         *oldDesk = desk;
     #endif
     
+    //последний полуход белых может поставить мат, только если объявляет шах;
+    //на остальных полуходах белых первыми перебираются шахи и взятия
     if(nPlysRest == 0)
         generateAllPlys(&plys, FinalPly);
+    else if(nPlysRest == 1 && desk.getIsWhiteTurn())
+        generateAllPlys(&plys, CheckingPly);
     else
+    {
         generateAllPlys(&plys, Generator);
+        if(desk.getIsWhiteTurn()){orderPlys(&plys);}
+    }
+    
+    if(isFirstProvingPlyKnown && plys.getIsContaining(firstProvingPly))
+    {
+        while(plys.front() != firstProvingPly){plys.pop();}
+    }
+    else if(isOrderingPlyKnown)
+    {
+        //ход, ведущий к более быстрому мату, гарантированно доказывает мат
+        plys.moveToFront(orderingPly);
+    }
     
     #ifndef NDEBUG
         //Сравнение копии состояния поля до хода
@@ -1008,6 +1487,15 @@ bool Chess::computeResolutionRecursion(const int nPlysRest, const ply *const chi
     bool isThisPathValid = false;
     bool isReturnedPathsValid = false;
     
+    //Продолжения после проверенных заранее защит черных сохраняются
+    //и встают в дерево в порядке генерации ходов, как без предварительной проверки.
+    PackedPly probedPlys[RefutationCandidates];
+    int probedSolutions[RefutationCandidates];
+    int probedAmount = 0;
+    //цепочка продолжений узла черных
+    int firstSolution = NoSolutionNode;
+    int lastSolution = NoSolutionNode;
+    
     if(plys.size() == 0)
     {
         //Нет возможных ходов
@@ -1025,9 +1513,10 @@ bool Chess::computeResolutionRecursion(const int nPlysRest, const ply *const chi
             {
                 //ход черных, черным мат
                 #ifndef NDEBUG
-                    printf("|");
+                    if(isPrinting){printf("|");}
                 #endif
                 //printf("\n"); printDesk(0, 0, false);
+                *solutionsTree = NoSolutionNode;
                 return true;
             }
             else
@@ -1040,6 +1529,52 @@ bool Chess::computeResolutionRecursion(const int nPlysRest, const ply *const chi
         }
     }
     
+    if(nPlysRest > 0 && !desk.getIsWhiteTurn())
+    {
+        //Первыми проверяются защиты, опровергавшие попытки белых ранее:
+        //из таблицы транспозиций, killers этой глубины и лучшая по history.
+        PackedPly candidates[RefutationCandidates];
+        int candidatesAmount = 0;
+        if(stored != NULL && stored->bound == TranspositionTable::Refuted)
+            {candidates[candidatesAmount++] = stored->bestMove;}
+        for(int j = 0; j < KillersAmount; j++){candidates[candidatesAmount++] = killers[nPlysRest][j];}
+        candidates[candidatesAmount++] = getBestHistoryPly(&plys);
+        assert(candidatesAmount <= RefutationCandidates);
+        
+        for(int i = 0; i < candidatesAmount; i++)
+        {
+            newMove = candidates[i];
+            bool isProbed = false;
+            for(int j = 0; j < probedAmount; j++){isProbed = isProbed || (probedPlys[j] == newMove);}
+            if(isProbed || !plys.getIsContaining(newMove)){continue;}
+            
+            #ifndef NDEBUG
+                Desk* oldDesk = new Desk; *oldDesk = desk;
+            #endif
+            
+            desk.makeMoveAhead(newMove, true);
+            isReturnedPathsValid = computeResolutionRecursion(nPlysRest - 1, &solutions);
+            desk.makeMoveBack(true);
+            
+            #ifndef NDEBUG
+                assert(desk == *oldDesk); delete oldDesk;
+            #endif
+            
+            if(isReturnedPathsValid == false)
+            {
+                noteRefutation(nPlysRest, newMove);
+                transpositions.store(desk.getHashKey(), nPlysRest,
+                                     TranspositionTable::Refuted, newMove);
+                solutionNodes.resize(solutionsMark);
+                return false;
+            }
+            
+            probedPlys[probedAmount] = newMove;
+            probedSolutions[probedAmount] = solutions;
+            probedAmount++;
+        }
+    }
+    
     if(nPlysRest > 0)
     {
         //не мат и не пат
@@ -1050,6 +1585,18 @@ bool Chess::computeResolutionRecursion(const int nPlysRest, const ply *const chi
             newMove = plys.front();
             plys.pop();
             
+            bool isProbed = false;
+            for(int j = 0; j < probedAmount && !isProbed; j++)
+            {
+                if(probedPlys[j] == newMove)
+                {
+                    //защита уже проверена, ее продолжения встают на место в порядке генерации
+                    isProbed = true;
+                    addSolutionNode(newMove, probedSolutions[j], &firstSolution, &lastSolution);
+                }
+            }
+            if(isProbed){continue;}
+            
             #ifndef NDEBUG
                 Desk* oldDesk = new Desk; *oldDesk = desk;
             #endif
@@ -1057,8 +1604,7 @@ bool Chess::computeResolutionRecursion(const int nPlysRest, const ply *const chi
             //применение хода и рекурсивный вызов функции, заполняющей список решений
             //(возможную ветвь решений из данного узла дерева решений)
             desk.makeMoveAhead(newMove, true);
-            isReturnedPathsValid = computeResolutionRecursion(nPlysRest - 1,
-                                                       &newMove, &solutions);
+            isReturnedPathsValid = computeResolutionRecursion(nPlysRest - 1, &solutions);
             desk.makeMoveBack(true);
             
             #ifndef NDEBUG
@@ -1076,43 +1622,20 @@ bool Chess::computeResolutionRecursion(const int nPlysRest, const ply *const chi
                     //(если будет сохранена на менее глубоких уровнях рекурсии)
                     //Сохраняем данную ветку (набор путей)
                     
-                    if(solutions.empty())
-                    {
-                        path.clear();
-                        if(childPly != NULL){path.push_front(*childPly);}
-                        path.push_back(newMove);
-                        
-                        childSolutions->push(path);
-                    }
-                    else
-                    {    
-                        while(!solutions.empty())
-                        {
-                            path.clear();
-                            path.swap(solutions.front());
-                            solutions.pop();
-                            if(childPly != NULL){path.push_front(*childPly);}
-                            childSolutions->push(path);
-                        }
-                    }
-                    
+                    *solutionsTree = NoSolutionNode;
+                    addSolutionNode(newMove, solutions, solutionsTree, &lastSolution);
                     
                     isThisPathValid = true;
                     
+                    transpositions.store(desk.getHashKey(), nPlysRest,
+                                         TranspositionTable::Proven, newMove);
                     return  true;
-                    //while(!solutions.empty())
-                    //    solutions.pop();
                 }
                 
                 //(ветвь достоверно не содержит решений)
                 //так что вся ветвь просто не сохранена как
                 
-                assert(solutions.empty());
-                
-                //while(!solutions.empty())
-                //{
-                //    solutions.pop();
-                //}
+                assert((int)solutionNodes.size() == solutionsMark);
             }
             else
             {
@@ -1122,8 +1645,14 @@ bool Chess::computeResolutionRecursion(const int nPlysRest, const ply *const chi
                     //помешать белым поставить мат в условленное число ходов.
                     //Данная ветка достоверно не является частью решения
                     //printf("%d", nPlysRest);
+                    noteRefutation(nPlysRest, newMove);
+                    transpositions.store(desk.getHashKey(), nPlysRest,
+                                         TranspositionTable::Refuted, newMove);
+                    solutionNodes.resize(solutionsMark);
                     return false;
                 }
+                
+                addSolutionNode(newMove, solutions, &firstSolution, &lastSolution);
             }
         }
         
@@ -1132,139 +1661,51 @@ bool Chess::computeResolutionRecursion(const int nPlysRest, const ply *const chi
             //Все полуходых черных из данной ситуации на доске
             //являются частью решений,
             //сохраняем их как ветвь дерева решений
-            while(!solutions.empty())
-            {
-                path.clear();
-                path.swap(solutions.front());
-                solutions.pop();
-                if(childPly != NULL){path.push_front(*childPly);}
-                childSolutions->push(path);
-            }
+            *solutionsTree = firstSolution;
         }
+        
+        //все полуходы черных ведут к мату либо ни один ход белых не ведет к мату
+        transpositions.store(desk.getHashKey(), nPlysRest,
+                             desk.getIsWhiteTurn() ? TranspositionTable::Refuted :
+                                                     TranspositionTable::Proven,
+                             PackedPly());
     }
     
     if(!desk.getIsWhiteTurn()){isThisPathValid = true;}
     return isThisPathValid;
 }
 
-bool Chess::generateKing(std::queue<ply> *plys,
-                         const int xPosition, const int yPosition,
-                         const OperatingMode mode)
+template<bool isWhite, Chess::OperatingMode mode>
+bool Chess::generateKing(PlyList *plys, const int xPosition, const int yPosition)
 {
-    //if(isCheckTest){printf("%d %d %d\n", xPosition, yPosition, desk.getField(xPosition, yPosition));}
+    assert(isWhite == desk.getIsWhiteTurn());
     assert((xPosition >= 1) && (xPosition <= DeskSizeX));
     assert((yPosition >= 1) && (yPosition <= DeskSizeY));
     
-    assert(getIsKing(xPosition, yPosition) ||
-          ((mode == CheckTest) &&
-          ((desk.getIsWhiteTurn() && yPosition == YWhiteKingCLine) ||
-           (!desk.getIsWhiteTurn() && yPosition == YBlackKingCLine)) &&
-           (xPosition == (XKingCPosition - 1) || xPosition == (XKingCPosition + 1))));
+    assert(getIsKing(xPosition, yPosition));
     
-    bool isCheckTest = false;
-    bool isFastReturning = false;
-    if(mode == CheckTest){isCheckTest = true;}
-    else
-    {
-        if(mode == FinalPly){isFastReturning = true;}
-    }
+    const bool isFastReturning = (mode == FinalPly);
     
-    int xNewPosition = 0;
-    int yNewPosition = 0;
-    for(int q = 0; q <= 7; q++)
+    int square = BitBoards::getSquare(xPosition, yPosition);
+    
+    //король не может идти на битые поля
+    BitBoard kingDanger = getKingDanger();
+    if(addMovesToSquares<mode>(plys, xPosition, yPosition,
+                         BitBoards::getKingSquares(square),
+                         ~desk.getSidePieces(isWhite) & ~kingDanger))
+    {return true;}
+    
+    if(legality.checkers == 0)
     {
-        switch(q)
+        int YkingCLine = 0;
+        bool isShortCPermit = false;
+        bool isLongCPermit = false;
+        
+        if(isWhite)
         {
-            case 0:
-            {//ходит вверх
-                xNewPosition = xPosition;
-                yNewPosition = yPosition + 1;
-                break;
-            }
-            case 1:
-            {//ходит вверх-вправо
-                xNewPosition = xPosition + 1;
-                yNewPosition = yPosition + 1;
-                break;
-            }
-            case 2:
-            {//ходит вправо
-                xNewPosition = xPosition + 1;
-                yNewPosition = yPosition;
-                break;
-            }
-            case 3:
-            {//ходит вниз-вправо
-                xNewPosition = xPosition + 1;
-                yNewPosition = yPosition - 1;
-                break;
-            }
-            case 4:
-            {//ходит вниз
-                xNewPosition = xPosition;
-                yNewPosition = yPosition - 1;
-                break;
-            }
-            case 5:
-            {//ходит вниз-влево
-                xNewPosition = xPosition - 1;
-                yNewPosition = yPosition - 1;
-                break;
-            }
-            case 6:
-            {//ходит влево
-                xNewPosition = xPosition - 1;
-                yNewPosition = yPosition;
-                break;
-            }
-            case 7:
-            {//ходит вверх-влево
-                xNewPosition = xPosition - 1;
-                yNewPosition = yPosition + 1;
-                break;
-            }
-        }
-    
-        if(desk.getField(xNewPosition, yNewPosition) == 0)
-        {
-            if(!isCheckTest)
-            {
-                addMove(plys, mode, xPosition, yPosition, xNewPosition, yNewPosition, 0, false, 0);
-                if(isFastReturning && plys->size() > 0){return true;}
-                //printf("%d %d\n", xNewPosition, yNewPosition);
-            }
-        }
-        else
-        {
-            if(getIsEnemy(xNewPosition, yNewPosition))
-            {
-                if(!isCheckTest)
-                {
-                    addMove(plys, mode, xPosition, yPosition, xNewPosition, yNewPosition,
-                            desk.getField(xNewPosition, yNewPosition), false, 0);
-                    if(isFastReturning && plys->size() > 0){return true;}
-                    //printf("%d %d\n", xNewPosition, yNewPosition);
-                }
-                else
-                {
-                    if(getIsKing(xNewPosition, yNewPosition))
-                    {return true;}
-                }
-            }
-        }
-    }
-    
-    if(!isCheckTest)
-    {
-        int YkingCLine = 0;
-        bool isShortCPermit = false;
-        bool isLongCPermit = false;
-        
-        if(desk.getIsWhiteTurn())
-        {
-            YkingCLine = YWhiteKingCLine;
-            isShortCPermit = desk.getIsWhiteShortCPermit();
-            isLongCPermit = desk.getIsWhiteLongCPermit();
+            YkingCLine = YWhiteKingCLine;
+            isShortCPermit = desk.getIsWhiteShortCPermit();
+            isLongCPermit = desk.getIsWhiteLongCPermit();
         }
         else
         {
@@ -1273,32 +1714,37 @@ bool Chess::generateKing(std::queue<ply> *plys,
             isLongCPermit = desk.getIsBlackLongCPermit();
         }
         
+        //король не под шахом (проверено выше), поле, через которое
+        //он проходит, и поле назначения не должны быть битыми
         if(isShortCPermit || isLongCPermit)
         {
-            if(!getIsFieldUnderAttack(XKingCPosition, YkingCLine))
+            if(getIsEmpty((XKingCPosition + 1), YkingCLine) &&
+               getIsEmpty((XKingCPosition + 2), YkingCLine))
             {
-                if(getIsEmpty((XKingCPosition + 1), YkingCLine) &&
-                   getIsEmpty((XKingCPosition + 2), YkingCLine))
+                if(isShortCPermit &&
+                   !(kingDanger & BitBoards::getBit(BitBoards::getSquare(XKingCPosition + 1,
+                                                                         YkingCLine))) &&
+                   !(kingDanger & BitBoards::getBit(BitBoards::getSquare(XKingCPosition + 2,
+                                                                         YkingCLine))))
                 {
-                    if(isShortCPermit &&
-                       !getIsFieldUnderAttack(XKingCPosition + 1, YkingCLine))
-                    {
-                        addMove(plys, mode, XKingCPosition, YkingCLine,
-                                XKingCPosition + 2, YkingCLine, 0, true, 0);
-                        if(isFastReturning && plys->size() > 0){return true;}
-                    }
+                    addMove(plys, mode, XKingCPosition, YkingCLine,
+                            XKingCPosition + 2, YkingCLine, 0, true, 0);
+                    if(isFastReturning && plys->size() > 0){return true;}
                 }
-                if(getIsEmpty((XKingCPosition - 1), YkingCLine) &&
-                   getIsEmpty((XKingCPosition - 2), YkingCLine) &&
-                   getIsEmpty((XKingCPosition - 3), YkingCLine))
+            }
+            if(getIsEmpty((XKingCPosition - 1), YkingCLine) &&
+               getIsEmpty((XKingCPosition - 2), YkingCLine) &&
+               getIsEmpty((XKingCPosition - 3), YkingCLine))
+            {
+                if(isLongCPermit &&
+                   !(kingDanger & BitBoards::getBit(BitBoards::getSquare(XKingCPosition - 1,
+                                                                         YkingCLine))) &&
+                   !(kingDanger & BitBoards::getBit(BitBoards::getSquare(XKingCPosition - 2,
+                                                                         YkingCLine))))
                 {
-                    if(isLongCPermit &&
-                       !getIsFieldUnderAttack(XKingCPosition - 1, YkingCLine))
-                    {
-                        addMove(plys, mode, XKingCPosition, YkingCLine,
-                                XKingCPosition - 2, YkingCLine, 0, true, 0);
-                        if(isFastReturning && plys->size() > 0){return true;}
-                    }
+                    addMove(plys, mode, XKingCPosition, YkingCLine,
+                            XKingCPosition - 2, YkingCLine, 0, true, 0);
+                    if(isFastReturning && plys->size() > 0){return true;}
                 }
             }
         }
@@ -1308,351 +1754,109 @@ bool Chess::generateKing(std::queue<ply> *plys,
     return false;
 }
 
-bool Chess::generateQueen(std::queue<ply> *plys,
-                          const int xPosition, const int yPosition,
-                          const OperatingMode mode)
+template<bool isWhite, Chess::OperatingMode mode>
+bool Chess::generateQueen(PlyList *plys, const int xPosition, const int yPosition)
 {
+    assert(isWhite == desk.getIsWhiteTurn());
     assert((xPosition >= 1) && (xPosition <= DeskSizeX));
     assert((yPosition >= 1) && (yPosition <= DeskSizeY));
     
-    assert(getIsQueen(xPosition, yPosition) ||
-           ((mode == CheckTest) && getIsKing(xPosition, yPosition)) ||
-          ((mode == CheckTest) &&
-          ((desk.getIsWhiteTurn() && yPosition == YWhiteKingCLine) ||
-           (!desk.getIsWhiteTurn() && yPosition == YBlackKingCLine)) &&
-           (xPosition == 4 || xPosition == 6)));
+    assert(getIsQueen(xPosition, yPosition));
     
-    return generateQRB(plys, 1, 1, xPosition, yPosition, mode);
+    return generateQRB<isWhite, mode>(plys, 1, 1, xPosition, yPosition);
 }
 
-bool Chess::generateRook(std::queue<ply> *plys,
-                         const int xPosition, const int yPosition,
-                         const OperatingMode mode)
+template<bool isWhite, Chess::OperatingMode mode>
+bool Chess::generateRook(PlyList *plys, const int xPosition, const int yPosition)
 {
+    assert(isWhite == desk.getIsWhiteTurn());
     assert((xPosition >= 1) && (xPosition <= DeskSizeX));
     assert((yPosition >= 1) && (yPosition <= DeskSizeY));
-    //printf("!%d %d %d\n", xPosition, yPosition, isCheckTest);
     
-    assert(getIsRook(xPosition, yPosition) ||
-           ((mode == CheckTest) && getIsKing(xPosition, yPosition)) ||
-          ((mode == CheckTest) &&
-          ((desk.getIsWhiteTurn() && yPosition == YWhiteKingCLine) ||
-           (!desk.getIsWhiteTurn() && yPosition == YBlackKingCLine)) &&
-           (xPosition == 4 || xPosition == 6)));
+    assert(getIsRook(xPosition, yPosition));
     
-    return generateQRB(plys, 1, 0, xPosition, yPosition, mode);
+    return generateQRB<isWhite, mode>(plys, 1, 0, xPosition, yPosition);
 }
 
-//bool Chess::generateKNight(int xPosition, int yPosition, bool isCheck)
-bool Chess::generateKNight(std::queue<ply> *plys,
-                           const int xPosition, const int yPosition,
-                           const OperatingMode mode)
+template<bool isWhite, Chess::OperatingMode mode>
+bool Chess::generateKNight(PlyList *plys, const int xPosition, const int yPosition)
 {
+    assert(isWhite == desk.getIsWhiteTurn());
     assert((xPosition >= 1) && (xPosition <= DeskSizeX));
     assert((yPosition >= 1) && (yPosition <= DeskSizeY));
     
-    assert(getIsKNight(xPosition, yPosition) ||
-          ((mode == CheckTest) && getIsKing(xPosition, yPosition)) ||
-          ((mode == CheckTest) &&
-          ((desk.getIsWhiteTurn() && yPosition == YWhiteKingCLine) ||
-           (!desk.getIsWhiteTurn() && yPosition == YBlackKingCLine)) &&
-           (xPosition == 4 || xPosition == 6)));
+    assert(getIsKNight(xPosition, yPosition));
     
-    bool isCheckTest = false;
-    bool isFastReturning = false;
-    if(mode == CheckTest){isCheckTest = true;}
-    else
-    {
-        if(mode == FinalPly){isFastReturning = true;}
-    }
+    int square = BitBoards::getSquare(xPosition, yPosition);
     
-    int xNewPosition = 0;
-    int yNewPosition = 0;
-    for(int q = 0; q <= 7; q++)
-    {
-        switch(q)
-        {
-            case 0:
-            {//ходит вверх-вверх-вправо
-                xNewPosition = xPosition + 1;
-                yNewPosition = yPosition + 2;
-                break;
-            }
-            case 1:
-            {//ходит вправо-вправо-вверх
-                xNewPosition = xPosition + 2;
-                yNewPosition = yPosition + 1;
-                break;
-            }
-            case 2:
-            {//ходит вправо-вправо-вниз
-                xNewPosition = xPosition + 2;
-                yNewPosition = yPosition - 1;
-                break;
-            }
-            case 3:
-            {//ходит вниз-вниз-вправо
-                xNewPosition = xPosition + 1;
-                yNewPosition = yPosition - 2;
-                break;
-            }
-            case 4:
-            {//ходит вниз-вниз-влево
-                xNewPosition = xPosition - 1;
-                yNewPosition = yPosition - 2;
-                break;
-            }
-            case 5:
-            {//ходит влево-влево-вниз
-                xNewPosition = xPosition - 2;
-                yNewPosition = yPosition - 1;
-                break;
-            }
-            case 6:
-            {//ходит влево-влево-вверх
-                xNewPosition = xPosition - 2;
-                yNewPosition = yPosition + 1;
-                break;
-            }
-            case 7:
-            {//ходит вверх-вверх-влево
-                xNewPosition = xPosition - 1;
-                yNewPosition = yPosition + 2;
-                break;
-            }
-        }
-        //if(xNewPosition >9 || xNewPosition <0 || yNewPosition >9 || yNewPosition <0)
-        //printf("KKK %d %d\n",xNewPosition, yNewPosition);
-        
-        if(xNewPosition <= (DeskSizeX + 1) && 
-           yNewPosition <= (DeskSizeY + 1) &&
-           xNewPosition >= 0 && yNewPosition >= 0) //Проверка ни перепрыгнет ли конь через "бортик".
-        {
-            if(desk.getField(xNewPosition, yNewPosition) == 0)
-            {
-                if(!isCheckTest)
-                {
-                    addMove(plys, mode, xPosition, yPosition,
-                            xNewPosition, yNewPosition, 0, false, 0);
-                    if(isFastReturning && plys->size() > 0){return true;}
-                    //printf("%d %d\n", xNewPosition, yNewPosition);
-                }
-            }
-            else
-            {
-                if(getIsEnemy(xNewPosition, yNewPosition))
-                {
-                    if(!isCheckTest)
-                    {
-                        addMove(plys, mode, xPosition, yPosition,
-                                xNewPosition, yNewPosition,
-                                desk.getField(xNewPosition, yNewPosition),
-                                false, 0);
-                        if(isFastReturning && plys->size() > 0){return true;}
-                        //printf("%d %d\n", xNewPosition, yNewPosition);
-                    }
-                    else
-                    {
-                        if(getIsKNight(xNewPosition, yNewPosition))
-                        {return true;}
-                    }
-                }
-            }
-        }
-    }
-        
-    return false;
+    return addMovesToSquares<mode>(plys, xPosition, yPosition,
+                             BitBoards::getKNightSquares(square),
+                             ~desk.getSidePieces(isWhite) &
+                             getAllowedFields(square) &
+                             getCheckingFields<mode>(square, WhiteKNight));
 }
 
-bool Chess::generateBishop(std::queue<ply> *plys,
-                           const int xPosition, const int yPosition,
-                           const OperatingMode mode)
+template<bool isWhite, Chess::OperatingMode mode>
+bool Chess::generateBishop(PlyList *plys, const int xPosition, const int yPosition)
 {
+    assert(isWhite == desk.getIsWhiteTurn());
     assert((xPosition >= 1) && (xPosition <= DeskSizeX));
     assert((yPosition >= 1) && (yPosition <= DeskSizeY));
     
-    assert(getIsBishop(xPosition, yPosition) ||
-          ((mode == CheckTest) && getIsKing(xPosition, yPosition)) ||
-           ((mode == CheckTest) &&
-          ((desk.getIsWhiteTurn() && yPosition == YWhiteKingCLine) ||
-           (!desk.getIsWhiteTurn() && yPosition == YBlackKingCLine)) &&
-           (xPosition == 4 || xPosition == 6)));
+    assert(getIsBishop(xPosition, yPosition));
     
-    return generateQRB(plys, 0, 1, xPosition, yPosition, mode);
+    return generateQRB<isWhite, mode>(plys, 0, 1, xPosition, yPosition);
 }
 
-bool Chess::generateQRB(std::queue<ply> *plys,
+template<bool isWhite, Chess::OperatingMode mode>
+bool Chess::generateQRB(PlyList *plys,
                         const bool isMovingLikeRook,
                         const bool isMovingLikeBishop,
-                        const int xPosition, const int yPosition,
-                        const OperatingMode mode)
+                        const int xPosition, const int yPosition)
 {
     assert((xPosition >= 1) && (xPosition <= DeskSizeX));
     assert((yPosition >= 1) && (yPosition <= DeskSizeY));
     assert(isMovingLikeRook || isMovingLikeBishop);
     
-    assert(getIsQueen(xPosition, yPosition) ||
-           getIsRook(xPosition, yPosition) ||
-           getIsBishop(xPosition, yPosition) ||
-          ((mode == CheckTest) && getIsKing(xPosition, yPosition)) ||
-           ((mode == CheckTest) &&
-          ((desk.getIsWhiteTurn() && yPosition == YWhiteKingCLine) ||
-           (!desk.getIsWhiteTurn() && yPosition == YBlackKingCLine)) &&
-           (xPosition == 4 || xPosition == 6)));
-    
     assert(((isMovingLikeRook && isMovingLikeBishop) &&
            getIsQueen(xPosition, yPosition)) ||
            ((isMovingLikeRook && !isMovingLikeBishop) &&
            getIsRook(xPosition, yPosition)) ||
            ((!isMovingLikeRook && isMovingLikeBishop) &&
-           getIsBishop(xPosition, yPosition)) ||
-          ((mode == CheckTest) && getIsKing(xPosition, yPosition)) ||
-           ((mode == CheckTest) &&
-          ((desk.getIsWhiteTurn() && yPosition == YWhiteKingCLine) ||
-           (!desk.getIsWhiteTurn() && yPosition == YBlackKingCLine)) &&
-           (xPosition == 4 || xPosition == 6)));
-    
-    bool isCheckTest = false;
-    bool isFastReturning = false;
-    if(mode == CheckTest){isCheckTest = true;}
-    else
-    {
-        if(mode == FinalPly){isFastReturning = true;}
-    }
+           getIsBishop(xPosition, yPosition)));
     
-    int xNewPosition = 0;
-    int yNewPosition = 0;
-    int xMovingMultiplier = 0;
-    int yMovingMultiplier = 0;
-    int iMax = 0;
-    int i = 0;
+    int square = BitBoards::getSquare(xPosition, yPosition);
+    BitBoard attacks = 0;
+    if(isMovingLikeRook)
+        {attacks |= BitBoards::getRookAttacks(square, desk.getOccupied());}
+    if(isMovingLikeBishop)
+        {attacks |= BitBoards::getBishopAttacks(square, desk.getOccupied());}
     
+    //ходы выдаются по лучам, вдоль луча - от ближнего поля к дальнему
     int qStart = 0;
     int qMax = 0;
-    
     if(isMovingLikeRook){qStart = 0;}else{qStart = 4;}
     if(isMovingLikeBishop){qMax = 7;}else{qMax = 3;}
     
+    attacks &= ~desk.getSidePieces(isWhite) & getAllowedFields(square);
+    if(isMovingLikeRook && isMovingLikeBishop){attacks &= getCheckingFields<mode>(square, WhiteQueen);}
+    else if(isMovingLikeRook){attacks &= getCheckingFields<mode>(square, WhiteRook);}
+    else{attacks &= getCheckingFields<mode>(square, WhiteBishop);}
     for(int q = qStart; q <= qMax; q++)
     {
-        xNewPosition = xPosition;
-        yNewPosition = yPosition;
-        
-        switch(q)
-        {
-            case 0:
-            {//ходит вверх
-                iMax = DeskSizeY;
-                xMovingMultiplier = 0;
-                yMovingMultiplier = 1;
-                break;
-            }
-            case 1:
-            {//ходит вправо
-                iMax = DeskSizeX;
-                xMovingMultiplier = 1;
-                yMovingMultiplier = 0;
-                break;
-            }
-            case 2:
-            {//ходит вниз
-                iMax = DeskSizeY;
-                xMovingMultiplier = 0;
-                yMovingMultiplier = -1;
-                break;
-            }
-            case 3:
-            {//ходит влево
-                iMax = DeskSizeX;
-                xMovingMultiplier = -1;
-                yMovingMultiplier = 0;
-                break;
-            }
-            case 4:
-            {//ходит вверх-вправо
-                iMax = DeskSizeY;
-                xMovingMultiplier = 1;
-                yMovingMultiplier = 1;
-                break;
-            }
-            case 5:
-            {//ходит вниз-вправо
-                iMax = DeskSizeY;
-                xMovingMultiplier = 1;
-                yMovingMultiplier = -1;
-                break;
-            }
-            case 6:
-            {//ходит вниз-влево
-                iMax = DeskSizeX;
-                xMovingMultiplier = -1;
-                yMovingMultiplier = -1;
-                break;
-            }
-            case 7:
-            {//ходит вверх-влево
-                iMax = DeskSizeX;
-                xMovingMultiplier = -1;
-                yMovingMultiplier = 1;
-                break;
-            }
-        }
-        
-        for(i = 1; i < iMax; i++)
-        {
-            xNewPosition = xPosition + (i * xMovingMultiplier);
-            yNewPosition = yPosition + (i * yMovingMultiplier);
-            if(desk.getField(xNewPosition, yNewPosition) > 0) {break;}
-            if(!isCheckTest)
-            {
-                addMove(plys, mode, xPosition, yPosition,
-                        xNewPosition, yNewPosition, 0, false, 0);
-                if(isFastReturning && plys->size() > 0){return true;}
-                //printf("%d %d\n", xNewPosition, yNewPosition);
-            }
-        }
-        
-        if(getIsEnemy(xNewPosition, yNewPosition))
-        {
-            if(!isCheckTest)
-            {
-                addMove(plys, mode, xPosition, yPosition,
-                        xNewPosition, yNewPosition,
-                        desk.getField(xNewPosition, yNewPosition), false, 0);
-                if(isFastReturning && plys->size() > 0){return true;}
-                //printf("%d %d >\n", xNewPosition, yNewPosition);
-            }
-            else
-            {
-                if((isMovingLikeRook && isMovingLikeBishop) &&
-                   getIsQueen(xNewPosition, yNewPosition))
-                {return true;}
-                
-                if((isMovingLikeRook && !isMovingLikeBishop) &&
-                   getIsRook(xNewPosition, yNewPosition))
-                {return true;}
-                
-                if((!isMovingLikeRook && isMovingLikeBishop) &&
-                   getIsBishop(xNewPosition, yNewPosition))
-                {return true;}
-            }
-        }
+        if(addMovesToTargets<mode>(plys, xPosition, yPosition,
+                             attacks & BitBoards::getRay(square, q),
+                             BitBoards::getIsRayReversed(q)))
+        {return true;}
     }
-    
     return false;
 }
 
-bool Chess::generatePawn(std::queue<ply> *plys,
-                         const int xPosition, const int yPosition,
-                         const OperatingMode mode)
+template<bool isWhite, Chess::OperatingMode mode>
+bool Chess::generatePawn(PlyList *plys, const int xPosition, const int yPosition)
 {
-    bool isCheckTest = false;
-    bool isFastReturning = false;
-    if(mode == CheckTest){isCheckTest = true;}
-    else
-    {
-        if(mode == FinalPly){isFastReturning = true;}
-    }
+    assert(isWhite == desk.getIsWhiteTurn());
+    const bool isFastReturning = (mode == FinalPly);
     
     int yStartLine = 0; //Линяя, стоя на которой пешка может сделать двухшаговый ход
     int yPromotionLine = 0; //Линяя, стоя на которую пешка может сделать ход и сразу превратиться
@@ -1664,7 +1868,7 @@ bool Chess::generatePawn(std::queue<ply> *plys,
     int xNewPosition = 0;
     int yNewPosition = 0;
     
-    if(desk.getIsWhiteTurn())
+    if(isWhite)
     {
         yStartLine = YWhiteStartPawnLine;
         directionMultiplier = 1;
@@ -1679,119 +1883,175 @@ bool Chess::generatePawn(std::queue<ply> *plys,
         whichPieceIfPromotionTerm = BlackIdSum;
     }
     IsPromotionAvailable = (yPosition == yPromotionLine);
-
-    if(!isCheckTest)
+    
+    int square = BitBoards::getSquare(xPosition, yPosition);
+    BitBoard attacks = BitBoards::getPawnAttacks(isWhite, square);
+    
+    int qMin = 0;
+    int qMax = 0;
+    if(IsPromotionAvailable)
+    {qMin = 1; qMax = 4;}
+    
+    BitBoard allowedFields = getAllowedFields(square);
+    BitBoard enPassantField = 0;
+    if(desk.getIsEnPassantPossible())
     {
-        int qMax = 0;
-        if(IsPromotionAvailable)
-        {qMax = 4;}
-        else
-        {qMax = 0;}
+        enPassantField = BitBoards::getBit(BitBoards::getSquare(desk.getXPosMovedPawn(),
+                                                                desk.getYPosMovedPawn() +
+                                                                directionMultiplier));
+    }
+    
+    for(int q = qMin; q <= qMax; q++)
+    {
+        //при q = 0, генерируется полуходы без превращения пешки
+        //при q > 0, генерируются полуходы с превращением пешки в различные фигуры
+        //(пешка, дошедшая до последней линии, обязана превратиться)
+        
+        if(q > 0){whichPieceIfPromotion = q + 1 + whichPieceIfPromotionTerm;}
+        else{whichPieceIfPromotion = 0;}
+        
+        xNewPosition = xPosition;
+        yNewPosition = yPosition + directionMultiplier;
         
-        for(int q = 0; q <= qMax; q++)
+        if(getIsEmpty(xNewPosition, yNewPosition))
         {
-            //при q = 0, генерируется полуходы без превращения пешки
-            //при q > 0, генерируются полуходы с превращением пешки в различные фигуры
-            
-            if(q > 0){whichPieceIfPromotion = q + 1 + whichPieceIfPromotionTerm;}
-            else{whichPieceIfPromotion = 0;}
-            
-
-            xNewPosition = xPosition;
-            yNewPosition = yPosition + directionMultiplier;
-            
-            if(getIsEmpty(xNewPosition, yNewPosition))
+        //одинарный ход вперед пешкой
+            if(allowedFields & BitBoards::getBit(BitBoards::getSquare(xNewPosition,
+                                                                      yNewPosition)))
             {
-            //одинарный ход вперед пешкой
                 addMove(plys, mode, xPosition, yPosition,
                         xNewPosition, yNewPosition,
                         0, false, whichPieceIfPromotion);
                 if(isFastReturning && plys->size() > 0){return true;}
-                
-                if(yStartLine == yPosition)
-                {
-                    //пешка может сделать двухшаговый ход
-                    yNewPosition = yPosition + (2 * directionMultiplier);
-                
-                    if(getIsEmpty(xNewPosition, yNewPosition))
-                    {
-                        //двойной ход вперед пешкой
-                        addMove(plys, mode, xPosition, yPosition,
-                                xNewPosition, yNewPosition,
-                                0, false, whichPieceIfPromotion);
-                        if(isFastReturning && plys->size() > 0){return true;}
-                    }
-                }
             }
-            for(int i = -1; i <= 1; i = i + 2)
+            
+            if(yStartLine == yPosition)
             {
-                //Генерируются диаганальные ходы для пешки
-                //со взятием фигуры противника
-                xNewPosition = xPosition + i;
-                yNewPosition = yPosition + directionMultiplier;
-                
-                if(getIsEnemy(xNewPosition, yNewPosition))
+                //пешка может сделать двухшаговый ход
+                yNewPosition = yPosition + (2 * directionMultiplier);
+            
+                if(getIsEmpty(xNewPosition, yNewPosition) &&
+                   (allowedFields & BitBoards::getBit(BitBoards::getSquare(xNewPosition,
+                                                                           yNewPosition))))
                 {
-                    //Генерируется полуходы со взятием любой фигуры
+                    //двойной ход вперед пешкой
                     addMove(plys, mode, xPosition, yPosition,
                             xNewPosition, yNewPosition,
-                            desk.getField(xNewPosition, yNewPosition),
-                            false, whichPieceIfPromotion);
+                            0, false, whichPieceIfPromotion);
                     if(isFastReturning && plys->size() > 0){return true;}
                 }
-                else
+            }
+        }
+        
+        //Генерируются диаганальные ходы для пешки
+        //со взятием фигуры противника, в том числе на проходе
+        BitBoard targets = attacks & ((desk.getSidePieces(!isWhite) &
+                                       allowedFields) | enPassantField);
+        while(targets != 0)
+        {
+            int newSquare = BitBoards::popFirstSquare(&targets);
+            xNewPosition = BitBoards::getXPosition(newSquare);
+            yNewPosition = BitBoards::getYPosition(newSquare);
+            
+            if(BitBoards::getBit(newSquare) & enPassantField)
+            {
+                //при взятии на проходе с доски уходят сразу две пешки,
+                //маски связок не учитывают такую связку по горизонтали,
+                //поэтому ход проверяется явно
+                PackedPly newMove = makePly(xPosition, yPosition,
+                                            xNewPosition, yNewPosition,
+                                            desk.getField(xNewPosition,
+                                                          yNewPosition - directionMultiplier),
+                                            false, whichPieceIfPromotion, true);
+                if(getIsPlyLegal(newMove))
                 {
-                    //Генерируется полуходы со взятием вражеской пешки на проходе
-                    //printf("%d %d %d\n",desk.getXPosMovedPawn(),desk.getYPosMovedPawn(),desk.getIsEnPassantPossible());
-                    if(desk.getXPosMovedPawn() == xNewPosition &&
-                       desk.getYPosMovedPawn() == (yNewPosition - directionMultiplier) &&
-                       desk.getIsEnPassantPossible())
-                    {
-                        addMove(plys, mode, xPosition, yPosition,
-                                xNewPosition, yNewPosition,
-                                desk.getField(xNewPosition,
-                                              yNewPosition - directionMultiplier),
-                                false, whichPieceIfPromotion);
-                                
-                        if(isFastReturning && plys->size() > 0){return true;}
-                    }
+                    addMove(plys, mode, newMove);
                 }
             }
+            else
+            {
+                addMove(plys, mode, xPosition, yPosition,
+                        xNewPosition, yNewPosition,
+                        desk.getField(xNewPosition, yNewPosition),
+                        false, whichPieceIfPromotion);
+            }
+            if(isFastReturning && plys->size() > 0){return true;}
         }
     }
-    else
+    
+    return false;
+}
+
+template<Chess::OperatingMode mode>
+bool Chess::addMovesToTargets(PlyList *plys,
+                              const int xSourceField, const int ySourceField,
+                              BitBoard targets, const bool isReversed)
+{
+    //Добавляет ходы фигуры на все поля из targets
+    //(поля либо пусты, либо заняты вражескими фигурами)
+    //в порядке возрастания номеров полей (или убывания при isReversed)
+    while(targets != 0)
     {
-        for(int i = -1; i <= 1; i = i + 2)
+        int newSquare = 0;
+        if(isReversed)
         {
-            //проверка, бъёт ли пешка заданное поле (в режиме CheckTest)
-            xNewPosition = xPosition + i;
-            yNewPosition = yPosition + directionMultiplier;
+            newSquare = 63 - __builtin_clzll(targets);
+            targets &= ~BitBoards::getBit(newSquare);
+        }
+        else
+        {
+            newSquare = BitBoards::popFirstSquare(&targets);
+        }
+        int xNewPosition = BitBoards::getXPosition(newSquare);
+        int yNewPosition = BitBoards::getYPosition(newSquare);
+        
+        addMove(plys, mode, xSourceField, ySourceField,
+                xNewPosition, yNewPosition,
+                desk.getField(xNewPosition, yNewPosition), false, 0);
+        if(mode == FinalPly && plys->size() > 0){return true;}
+    }
     
-            if(getIsEnemy(xNewPosition, yNewPosition))
-            {
-                if(getIsPawn(xNewPosition, yNewPosition))
-                {return true;}
-            }
+    return false;
+}
+
+template<Chess::OperatingMode mode>
+bool Chess::addMovesToSquares(PlyList *plys,
+                              const int xSourceField, const int ySourceField,
+                              const signed char *const squares,
+                              const BitBoard allowedFields)
+{
+    //Добавляет ходы короля или коня по таблице полей
+    //(в порядке обхода направлений), пропуская поля не из allowedFields
+    for(int q = 0; q <= 7 && squares[q] >= 0; q++)
+    {
+        if(allowedFields & BitBoards::getBit(squares[q]))
+        {
+            int xNewPosition = BitBoards::getXPosition(squares[q]);
+            int yNewPosition = BitBoards::getYPosition(squares[q]);
+            
+            addMove(plys, mode, xSourceField, ySourceField,
+                    xNewPosition, yNewPosition,
+                    desk.getField(xNewPosition, yNewPosition), false, 0);
+            if(mode == FinalPly && plys->size() > 0){return true;}
         }
     }
+    
     return false;
 }
 
+template<bool isWhite>
 inline bool Chess::getIsEnemy(const int xPosition, const int yPosition)
 {
     //printf(" %d W%d +", pieceID, isWhiteTurn);
+    assert(isWhite == desk.getIsWhiteTurn());
     int pieceID = desk.getField(xPosition, yPosition);
     
-    if((desk.getIsWhiteTurn() == true) &&
-       ((pieceID >= BlackIdSum + 1) &&
-        (pieceID <= BlackIdSum + AmountTypesOfPieces)))
-    {return true;}
-    
-    if((desk.getIsWhiteTurn() == false) &&
-       ((pieceID >= 1) && (pieceID <= AmountTypesOfPieces)))
-    {return true;}
-    
-    return false;
+    if(isWhite)
+    {
+        return ((pieceID >= BlackIdSum + 1) &&
+                (pieceID <= BlackIdSum + AmountTypesOfPieces));
+    }
+    return ((pieceID >= 1) && (pieceID <= AmountTypesOfPieces));
 }
 
 inline bool Chess::getIsEmpty(const int xPosition, const int yPosition)
@@ -1858,11 +2118,12 @@ inline bool Chess::getIsPawn(const int xPosition, const int yPosition)
 
 void Chess::Desk::setDesk(const bool isWhiteFirst, const bool isEnPassant,
                           const int xPawnPosIfEnPassant,
-                          const int yPawnPosIfEnPassant, const int totalPlys,
-                          std::list<pieceForIn> * const pieces)
+                          const int yPawnPosIfEnPassant, const int castlingPermits,
+                          const int totalPlys, const pieceForIn * const pieces,
+                          const int piecesAmount)
 {
     assert(pieces != NULL);
-    assert(!pieces->empty());
+    assert(piecesAmount > 0);
     
     isWhiteTurn = isWhiteFirst;
     isEnPassantPossible = isEnPassant;
@@ -1872,34 +2133,74 @@ void Chess::Desk::setDesk(const bool isWhiteFirst, const bool isEnPassant,
         yPosMovedPawn = yPawnPosIfEnPassant;
     }    
     
-    std::list<pieceForIn>::iterator i = pieces->begin();
-    if (!pieces->empty())
-        for (i; i != pieces->end(); ++i)
-            setField(i->xPosition, i->yPosition,
-                     i->pieceType);
+    for(int i = 0; i < piecesAmount; i++)
+        setField(pieces[i].xPosition, pieces[i].yPosition,
+                 pieces[i].pieceType);
     
     previousPlys.reserve(totalPlys + 2);
     
     initDesk();
+    
+    if(castlingPermits != CastlingByPosition)
+    {
+        //права из условия (FEN) - только при короле и ладье на исходных полях
+        isWhiteShortCPermit = isWhiteShortCPermit && (castlingPermits & 1) != 0;
+        isWhiteLongCPermit = isWhiteLongCPermit && (castlingPermits & 2) != 0;
+        isBlackShortCPermit = isBlackShortCPermit && (castlingPermits & 4) != 0;
+        isBlackLongCPermit = isBlackLongCPermit && (castlingPermits & 8) != 0;
+        hashKey = computeHashKey();
+    }
 }
 
 void Chess::loadChessProblem(const bool isWhiteFirst,
                              const bool isEnPassant,
                              const int xPawnPosIfEnPassant,
-                             const int yPawnPosIfEnPassant, const int nMoves,
-                             std::list<pieceForIn> * const pieces)
+                             const int yPawnPosIfEnPassant, const int castlingPermits,
+                             const int nMoves, std::list<pieceForIn> * const pieces)
 {
+    assert(pieces != NULL);
+    assert(pieces->size() <= DeskSizeX * DeskSizeY);
     
+    pieceForIn piecesArray[DeskSizeX * DeskSizeY];
+    int piecesAmount = 0;
+    for(std::list<pieceForIn>::iterator i = pieces->begin(); i != pieces->end(); ++i)
+        piecesArray[piecesAmount++] = *i;
+    
+    loadChessProblem(isWhiteFirst, isEnPassant, xPawnPosIfEnPassant, yPawnPosIfEnPassant,
+                     castlingPermits, nMoves, piecesArray, piecesAmount);
+}
+
+void Chess::loadChessProblem(const bool isWhiteFirst,
+                             const bool isEnPassant,
+                             const int xPawnPosIfEnPassant,
+                             const int yPawnPosIfEnPassant, const int castlingPermits,
+                             const int nMoves, const pieceForIn * const pieces,
+                             const int piecesAmount)
+{
+    reset();
     totalPlys = nMoves * 2 - 1;
     
-    desk.setDesk(isWhiteFirst, isEnPassant,
-                 xPawnPosIfEnPassant, yPawnPosIfEnPassant, totalPlys, pieces);
+    desk.setDesk(isWhiteFirst, isEnPassant, xPawnPosIfEnPassant, yPawnPosIfEnPassant,
+                 castlingPermits, totalPlys, pieces, piecesAmount);
+}
+
+void Chess::reset()
+{
+    desk.clearDesk();
+    totalPlys = 0;
+    isColorsSwapped = false;
+    transpositions.startGeneration();
+    solutionNodes.clear();
+    proofNodes.clear();
+    nodesAmount = 0;
+    searchAllocationsAmount = 0;
 }
 
 void Chess::loadTestOut(FILE *f)
 {
     
-    ply newMove;
+    int xSourceField, ySourceField, xDestinationField, yDestinationField;
+    int whichPieceIfTaking, isCastling, whichPieceIfPromotion;
     int movesAmount = 0;
     
     int fErr = 0;
@@ -1908,206 +2209,1530 @@ void Chess::loadTestOut(FILE *f)
         
     for(int k = 0; k < movesAmount; k++)
     {
-        fErr = fscanf(f, "%d", &newMove.xSourceField);
+        fErr = fscanf(f, "%d", &xSourceField);
         assert(fErr == 1);
-        fErr = fscanf(f, "%d", &newMove.ySourceField);
+        fErr = fscanf(f, "%d", &ySourceField);
         assert(fErr == 1);
-        fErr = fscanf(f, "%d", &newMove.xDestinationField);
+        fErr = fscanf(f, "%d", &xDestinationField);
         assert(fErr == 1);
-        fErr = fscanf(f, "%d", &newMove.yDestinationField);
+        fErr = fscanf(f, "%d", &yDestinationField);
         assert(fErr == 1);
-        fErr = fscanf(f, "%d", &newMove.whichPieceIfTaking);
+        fErr = fscanf(f, "%d", &whichPieceIfTaking);
         assert(fErr == 1);
-        fErr = fscanf(f, "%d", &newMove.isCastling);
+        fErr = fscanf(f, "%d", &isCastling);
         assert(fErr == 1);
-        fErr = fscanf(f, "%d", &newMove.whichPieceIfPromotion);
+        fErr = fscanf(f, "%d", &whichPieceIfPromotion);
         assert(fErr == 1);
         
-        testingOut.push_back(newMove);
+        //Ходящая фигура в тестовых файлах не указана и при сравнении не учитывается
+        testingOut.push_back(PackedPly(BitBoards::getSquare(xSourceField, ySourceField),
+                                       BitBoards::getSquare(xDestinationField, yDestinationField),
+                                       Empty, whichPieceIfTaking, isCastling != 0,
+                                       whichPieceIfPromotion, false));
         
     }
     
 }
 
 
-void Chess::compute(std::list< std::list<plyForOut> > * const solutionsForOut)
+int Chess::compute(solutionVisitor * const visitor)
 {
     //ply emptyRoot;
     //emptyRoot.plyNo = -1;
     
-    std::queue< std::list<ply> > solutions;
-    this->computeResolutionRecursion(totalPlys, NULL, &solutions);
-
-    printf("\n%d\nPATHS:\n", solutions.size());
-    std::list<ply> path;
+    if(!transpositions.getIsAllocated()){transpositions.setSize(DefaultHashMegaBytes);}
+    clearRefutations();
+    const unsigned long long allocationsAmount = getHeapAllocationsAmount();
+    nodesAmount = 0;
     
-    //std::list< std::list<plyForOut> > solutionsForOut;
+    solutionNodes.clear();
+    int solutions = NoSolutionNode;
+    bool isSolved = false;
+    if(threadsAmount > 1)
+        {isSolved = computeResolutionParallel(totalPlys, &solutions);}
+    else
+        {isSolved = this->computeResolutionRecursion(totalPlys, &solutions);}
+    if(!isSolved){solutions = NoSolutionNode;}
+    searchAllocationsAmount = getHeapAllocationsAmount() - allocationsAmount;
+
+    const int pathsAmount = getSolutionPathsAmount(solutions);
+    if(isPrinting){printf("\n%d\nPATHS:\n", pathsAmount);}
     
-    std::list<plyForOut> pathForOut;
-    plyForOut plyOuter;
-    ply plyInner;
-    while(!solutions.empty())
+    if(visitor != NULL)
     {
-        pathForOut.clear();
-        
-        path = solutions.front();
-        solutions.pop();
-        
-        while(!path.empty())
-        {
-            plyInner = path.front();
-            path.pop_front();
-            
-            plyOuter.plyNo = plyInner.plyNo;
-            plyOuter.pieceType = plyInner.movingPieceType;
-            plyOuter.pieceSymbol = Chess::getPieceSymbol(plyInner.movingPieceType);
-            plyOuter.xSourceField = plyInner.xSourceField;
-            plyOuter.ySourceField = plyInner.ySourceField;
-            plyOuter.xDestinationField = plyInner.xDestinationField;
-            plyOuter.yDestinationField = plyInner.yDestinationField;
-            plyOuter.isCastling = plyInner.isCastling;
-            plyOuter.whichPieceIfPromotion = plyInner.whichPieceIfPromotion;
-            plyOuter.isCastling = plyInner.isCastling;
-            
-            pathForOut.push_back(plyOuter);
-        }
-        
-        solutionsForOut->push_back(pathForOut);
-        
+        plyForOut path[MaxPlys];
+        visitSolutions(solutions, path, 0, visitor);
     }
+    
+    return pathsAmount;
 }
 
-bool Chess::test()
+bool Chess::computeResolutionParallel(const int nPlysRest, int *const solutionsTree)
 {
-    std::list<ply>::iterator i = testing.begin();
-     std::list<ply>::iterator j = testingOut.begin();
-     
-    if(!testingOut.empty() && !testing.empty())
-    {
-        for(i, j; j != testingOut.end(); ++i, ++j)
-        {
-            if(i == testing.end()){return false;}
-            
-            if(i->xSourceField != j->xSourceField ||
-               i->ySourceField != j->ySourceField ||
-               i->xDestinationField != j->xDestinationField ||
-               i->yDestinationField != j->yDestinationField ||
-               i->whichPieceIfTaking != j->whichPieceIfTaking ||
-               i->whichPieceIfPromotion != j->whichPieceIfPromotion ||
-               i->isCastling != j->isCastling)
-                {return false;}
-        }
-        if(i != testing.end()){return false;}
-    }
-    else{return false;}
-        
-    return true;
+    assert(desk.getIsWhiteTurn());
+    assert(nPlysRest > 0);
+    assert(threadsAmount > 1);
+    
+    if(!computeIsMate(nPlysRest)){return false;}
+    
+    //Сбор путей. В таблице остаются первые в порядке перебора доказывающие
+    //ходы белых, так что набор путей совпадает с последовательным поиском.
+    //Подсказка кратчайшего мата не используется: какие позиции доказаны
+    //на меньшей глубине, зависит от распределения работы между потоками.
+    const bool isShortest = isShortestMateSearch;
+    isShortestMateSearch = false;
+    bool isSolved = computeResolutionRecursion(nPlysRest, solutionsTree);
+    isShortestMateSearch = isShortest;
+    assert(isSolved);
+    
+    return isSolved;
 }
 
+bool Chess::computeIsMate(const int nPlysRest)
+{
+    assert(transpositions.getIsAllocated());
+    
+    if(threadsAmount == 1){return searchParallel(nPlysRest, NULL);}
+    
+    splitPool sharedPool;
+    std::vector<Chess> workers(threadsAmount - 1);
+    std::vector<std::thread> threads;
+    startHelpers(&sharedPool, &workers, &threads);
+    bool isSolved = searchParallel(nPlysRest, NULL);
+    stopHelpers(&sharedPool, &workers, &threads);
+    
+    return isSolved;
+}
 
+void Chess::startHelpers(splitPool *const sharedPool, std::vector<Chess> *const workers,
+                         std::vector<std::thread> *const threads)
+{
+    assert(threadsAmount > 1 && workers->size() == (size_t)threadsAmount - 1);
+    
+    sharedPool->idleAmount = threadsAmount - 1;
+    sharedPool->isFinished = false;
+    sharedPool->splits.reserve(threadsAmount * MaxPlys);
+    
+    threads->reserve(threadsAmount - 1);
+    for(int t = 0; t < threadsAmount - 1; t++)
+    {
+        (*workers)[t].desk = desk;
+        (*workers)[t].totalPlys = totalPlys;
+        (*workers)[t].transpositions.share(transpositions);
+        (*workers)[t].pool = sharedPool;
+        threads->push_back(std::thread(&Chess::workParallel, &(*workers)[t]));
+    }
+    pool = sharedPool;
+}
 
+void Chess::stopHelpers(splitPool *const sharedPool, std::vector<Chess> *const workers,
+                        std::vector<std::thread> *const threads)
+{
+    pool = NULL;
+    sharedPool->isFinished = true;
+    for(int t = 0; t < threadsAmount - 1; t++)
+    {
+        (*threads)[t].join();
+        nodesAmount += (*workers)[t].nodesAmount;
+    }
+}
 
-
-
-
-bool loadChessProblemFromFile(const std::string fileName,
-                              Chess * const chess, const bool isMirror)
+bool Chess::getIsAborted(const splitFrame *frame)
 {
-    FILE *f;
-    f = fopen(fileName.c_str(), "r");
-    if(f == 0)
+    //перебор отменен, если в каком-либо узле разделения выше
+    //найдено опровержение черных или доказывающий ход белых раньше по порядку
+    for(; frame != NULL; frame = frame->parent)
     {
-        printf("File can't be open or doesn't exist (check the file name)\n");
+        if(frame->split->isWhiteNode)
+        {
+            if(frame->plyIndex > frame->split->firstProvingPly){return true;}
+        }
+        else if(frame->split->isRefuted){return true;}
+    }
+    return false;
+}
+
+bool Chess::searchParallel(const int nPlysRest, const splitFrame *const frame)
+{
+    //То же, что computeResolutionRecursion, но без сбора путей
+    //(вне параллельного поиска pool == NULL и перебор не делится).
+    //Результат отмененного перебора (getIsAborted) не имеет смысла
+    //и в таблицу не записывается.
+    assert(false == ((nPlysRest == 0) && desk.getIsWhiteTurn()));
+    assert(nPlysRest >= 0 && nPlysRest < MaxPlys);
+    
+    if(getIsAborted(frame)){return false;}
+    nodesAmount++;
+    
+    const bool isWhite = desk.getIsWhiteTurn();
+    TranspositionTable::entry stored;
+    bool isStored = false;
+    if(nPlysRest > 0)
+    {
+        isStored = transpositions.probe(desk.getHashKey(), &stored);
+        if(isStored)
+        {
+            if(stored.bound == TranspositionTable::Refuted && stored.depth >= nPlysRest)
+                {return false;}
+            if(stored.bound == TranspositionTable::Proven && stored.depth <= nPlysRest)
+                {return true;}
+        }
+    }
+    
+    PlyList plys;
+    if(nPlysRest == 0)
+        generateAllPlys(&plys, FinalPly);
+    else if(nPlysRest == 1 && isWhite)
+        generateAllPlys(&plys, CheckingPly);
+    else
+    {
+        generateAllPlys(&plys, Generator);
+        if(isWhite){orderPlys(&plys);}
+    }
+    
+    if(plys.size() == 0)
+    {
+        //белым мат или пат - мата черным нет; черным мат или пат
+        if(isWhite){return false;}
+        return getIsFieldUnderAttack(desk.getXBlackKingPosition(),
+                                     desk.getYBlackKingPosition());
+    }
+    if(nPlysRest == 0){return false;}
+    
+    if(!isWhite)
+    {
+        //опровергавшие ранее защиты черных - первыми
+        plys.moveToFront(getBestHistoryPly(&plys));
+        for(int j = KillersAmount - 1; j >= 0; j--){plys.moveToFront(killers[nPlysRest][j]);}
+        if(isStored && stored.bound == TranspositionTable::Refuted)
+            {plys.moveToFront(stored.bestMove);}
+    }
+    
+    bool isResolved = false; //найден доказывающий ход белых или опровержение черных
+    PackedPly resolvingPly;
+    while(!plys.empty())
+    {
+        PackedPly newMove = plys.front();
+        plys.pop();
+        
+        desk.makeMoveAhead(newMove, true);
+        bool isReturned = searchParallel(nPlysRest - 1, frame);
+        desk.makeMoveBack(true);
+        
+        if(getIsAborted(frame)){return false;}
+        if(isReturned == isWhite)
+        {
+            isResolved = true;
+            resolvingPly = newMove;
+            break;
+        }
+        
+        //первый полуход перебран, остальные можно отдать свободным потокам
+        if(pool != NULL && pool->idleAmount > 0 &&
+           nPlysRest >= ParallelSplitPlys && plys.size() > 1)
+        {
+            isResolved = searchSplit(nPlysRest, frame, &plys, &resolvingPly);
+            if(getIsAborted(frame)){return false;}
+            break;
+        }
+    }
+    
+    if(isWhite)
+    {
+        transpositions.store(desk.getHashKey(), nPlysRest,
+                             isResolved ? TranspositionTable::Proven : TranspositionTable::Refuted,
+                             resolvingPly);
+        return isResolved;
+    }
+    
+    if(isResolved){noteRefutation(nPlysRest, resolvingPly);}
+    transpositions.store(desk.getHashKey(), nPlysRest,
+                         isResolved ? TranspositionTable::Refuted : TranspositionTable::Proven,
+                         resolvingPly);
+    return !isResolved;
+}
+
+bool Chess::searchSplit(const int nPlysRest, const splitFrame *const frame,
+                        PlyList *plys, PackedPly *resolvingPly)
+{
+    assert(pool != NULL);
+    
+    assert(nPlysRest < MaxPlys);
+    splitPoint *split = &splitPoints[nPlysRest];
+    split->desk = desk;
+    split->plys = *plys;
+    split->nPlysRest = nPlysRest;
+    split->isWhiteNode = desk.getIsWhiteTurn();
+    split->parentFrame = frame;
+    split->nextPly = 0;
+    split->firstProvingPly = plys->size();
+    split->isRefuted = false;
+    split->refutation = 0;
+    split->workersAmount = 1;
+    
+    {
+        std::lock_guard<std::mutex> lock(pool->mutex);
+        pool->splits.push_back(split);
+    }
+    
+    workOnSplit(split);
+    
+    {
+        std::lock_guard<std::mutex> lock(pool->mutex);
+        for(size_t i = 0; i < pool->splits.size(); i++)
+        {
+            if(pool->splits[i] == split)
+            {
+                pool->splits.erase(pool->splits.begin() + i);
+                break;
+            }
+        }
+    }
+    
+    //пока помощники заканчивают, владелец узла помогает им в их поддеревьях
+    pool->idleAmount++;
+    while(split->workersAmount > 1)
+    {
+        if(!helpSplits(split)){std::this_thread::yield();}
+    }
+    pool->idleAmount--;
+    
+    bool isResolved = false;
+    if(split->isWhiteNode)
+    {
+        isResolved = (split->firstProvingPly < split->plys.size());
+        if(isResolved){*resolvingPly = split->plys.at(split->firstProvingPly);}
+    }
+    else
+    {
+        isResolved = split->isRefuted;
+        if(isResolved){*resolvingPly = PackedPly(split->refutation.load());}
+    }
+    
+    return isResolved;
+}
+
+void Chess::workOnSplit(splitPoint *const split)
+{
+    for(int i = split->nextPly++; i < split->plys.size(); i = split->nextPly++)
+    {
+        splitFrame frame = {split, i, split->parentFrame};
+        if(getIsAborted(&frame)){break;}
+        
+        PackedPly newMove = split->plys.at(i);
+        desk.makeMoveAhead(newMove, true);
+        bool isReturned = searchParallel(split->nPlysRest - 1, &frame);
+        desk.makeMoveBack(true);
+        
+        if(getIsAborted(&frame)){continue;}
+        
+        if(split->isWhiteNode && isReturned)
+        {
+            int first = split->firstProvingPly;
+            while(i < first && !split->firstProvingPly.compare_exchange_weak(first, i)){}
+        }
+        if(!split->isWhiteNode && !isReturned)
+        {
+            split->refutation = newMove.getCode();
+            split->isRefuted = true;
+        }
+    }
+}
+
+bool Chess::helpSplits(const splitPoint *const ownSplit)
+{
+    //Берется узел разделения с наибольшим запасом полуходов
+    //(для владельца узла ownSplit - только из его поддеревьев).
+    splitPoint *split = NULL;
+    {
+        std::lock_guard<std::mutex> lock(pool->mutex);
+        for(size_t i = 0; i < pool->splits.size(); i++)
+        {
+            splitPoint *candidate = pool->splits[i];
+            if(candidate->nextPly >= candidate->plys.size()){continue;}
+            
+            bool isInSubtree = (ownSplit == NULL);
+            for(const splitFrame *f = candidate->parentFrame; f != NULL && !isInSubtree; f = f->parent)
+                {isInSubtree = (f->split == ownSplit);}
+            if(!isInSubtree){continue;}
+            
+            if(split == NULL || candidate->nPlysRest > split->nPlysRest){split = candidate;}
+        }
+        if(split == NULL){return false;}
+        split->workersAmount++;
+    }
+    
+    //владелец узла ownSplit после помощи возвращается в позицию своего узла
+    pool->idleAmount--;
+    desk = split->desk;
+    workOnSplit(split);
+    if(ownSplit != NULL){desk = ownSplit->desk;}
+    pool->idleAmount++;
+    
+    split->workersAmount--;
+    return true;
+}
+
+void Chess::workParallel()
+{
+    //основной цикл вспомогательного потока
+    while(!pool->isFinished)
+    {
+        if(!helpSplits(NULL)){std::this_thread::yield();}
+    }
+}
+
+int Chess::computeShortest(solutionVisitor * const visitor)
+{
+    //Итерации по числу ходов. Таблица транспозиций сохраняется между итерациями:
+    //доказанные на меньшей глубине позиции дают первый перебираемый ход белых
+    if(!transpositions.getIsAllocated()){transpositions.setSize(DefaultHashMegaBytes);}
+    clearRefutations();
+    const unsigned long long allocationsAmount = getHeapAllocationsAmount();
+    nodesAmount = 0;
+    
+    solutionNodes.clear();
+    int solutions = NoSolutionNode;
+    int nMovesMax = (totalPlys + 1) / 2;
+    int nMoves = 0;
+    
+    isShortestMateSearch = true;
+    for(nMoves = 1; nMoves <= nMovesMax; nMoves++)
+    {
+        if(threadsAmount > 1)
+        {
+            if(computeResolutionParallel(nMoves * 2 - 1, &solutions)){break;}
+        }
+        else if(computeResolutionRecursion(nMoves * 2 - 1, &solutions)){break;}
+        assert(solutionNodes.empty());
+    }
+    isShortestMateSearch = false;
+    
+    if(nMoves > nMovesMax)
+    {
+        nMoves = 0;
+        solutions = NoSolutionNode;
+    }
+    
+    searchAllocationsAmount = getHeapAllocationsAmount() - allocationsAmount;
+    if(isPrinting){printf("\nMATE IN %d\n%d\nPATHS:\n", nMoves, getSolutionPathsAmount(solutions));}
+    
+    if(visitor != NULL)
+    {
+        plyForOut path[MaxPlys];
+        visitSolutions(solutions, path, 0, visitor);
+    }
+    
+    return nMoves;
+}
+
+int Chess::computeKeys(solutionVisitor * const visitor, const bool isCooksCounting)
+{
+    assert(desk.getIsWhiteTurn());
+    if(!transpositions.getIsAllocated()){transpositions.setSize(DefaultHashMegaBytes);}
+    clearRefutations();
+    const unsigned long long allocationsAmount = getHeapAllocationsAmount();
+    nodesAmount = 0;
+    //задача без ходов (loadChessProblem с nMoves < 1) - решений нет
+    if(totalPlys < 1){return 0;}
+    
+    //первые ходы белых в том же порядке, что и в computeResolutionRecursion
+    PlyList plys;
+    if(totalPlys == 1)
+        generateAllPlys(&plys, CheckingPly);
+    else
+    {
+        generateAllPlys(&plys, Generator);
+        orderPlys(&plys);
+    }
+    
+    if(isPrinting){printf("\nKEYS:\n");}
+    
+    //вспомогательные потоки создаются один раз на все первые ходы:
+    //между поисками они ждут работы в workParallel
+    splitPool sharedPool;
+    std::vector<Chess> workers(threadsAmount - 1);
+    std::vector<std::thread> threads;
+    if(threadsAmount > 1){startHelpers(&sharedPool, &workers, &threads);}
+    
+    int keysAmount = 0;
+    while(!plys.empty())
+    {
+        PackedPly newMove = plys.front();
+        plys.pop();
+        
+        desk.makeMoveAhead(newMove, true);
+        bool isKey = searchParallel(totalPlys - 1, NULL);
+        desk.makeMoveBack(true);
+        
+        if(isKey)
+        {
+            keysAmount++;
+            if(visitor != NULL)
+            {
+                plyForOut key = getPlyForOut(newMove, 0);
+                visitor->visitPath(&key, 1);
+            }
+            if(!isCooksCounting){break;}
+        }
+    }
+    if(threadsAmount > 1){stopHelpers(&sharedPool, &workers, &threads);}
+    
+    searchAllocationsAmount = getHeapAllocationsAmount() - allocationsAmount;
+    if(isPrinting){printf("\n%d KEYS\n", keysAmount);}
+    
+    return keysAmount;
+}
+
+void Chess::evaluateProofNode(proofNode *const node)
+{
+    //Начальные числа доказательства для нового узла (позиция узла - на доске).
+    //Ход белых - узел "или": достаточно одного хода, ведущего к мату;
+    //ход черных - узел "и": к мату должны вести все ходы
+    PlyList plys;
+    
+    if(node->nPlysRest == 0)
+        {generateAllPlys(&plys, FinalPly);}
+    else if(node->nPlysRest == 1 && desk.getIsWhiteTurn())
+        {generateAllPlys(&plys, CheckingPly);}
+    else
+        {generateAllPlys(&plys, Generator);}
+    
+    bool isMate = false;
+    if(plys.size() == 0)
+    {
+        //ходов нет: мат черным (доказано), иначе - пат или мат белым,
+        //либо у белых нет шахующего хода на последнем полуходе
+        isMate = !desk.getIsWhiteTurn() &&
+                 getIsFieldUnderAttack(desk.getXBlackKingPosition(),
+                                       desk.getYBlackKingPosition());
+        node->proof = isMate ? 0 : ProofInfinity;
+        node->disproof = isMate ? ProofInfinity : 0;
+        return;
+    }
+    if(node->nPlysRest == 0)
+    {
+        //последний полуход черных, не мат
+        node->proof = ProofInfinity;
+        node->disproof = 0;
+        return;
+    }
+    
+    //число доступных ходов - оценка трудности доказательства (опровержения)
+    if(desk.getIsWhiteTurn())
+    {
+        node->proof = 1;
+        node->disproof = plys.size();
+    }
+    else
+    {
+        node->proof = plys.size();
+        node->disproof = 1;
+    }
+}
+
+bool Chess::expandProofNode(const int nodeIndex)
+{
+    //Создание и оценка детей узла (позиция узла - на доске).
+    //Возвращает false, если в таблице узлов нет места
+    PlyList plys;
+    
+    if(proofNodes[nodeIndex].nPlysRest == 1 && desk.getIsWhiteTurn())
+        {generateAllPlys(&plys, CheckingPly);}
+    else
+    {
+        generateAllPlys(&plys, Generator);
+        if(desk.getIsWhiteTurn()){orderPlys(&plys);}
+    }
+    
+    assert(plys.size() > 0);
+    if((int)proofNodes.size() + plys.size() > proofNodesLimit){return false;}
+    
+    int firstChild = proofNodes.size();
+    int nPlysRest = proofNodes[nodeIndex].nPlysRest - 1;
+    proofNode child;
+    
+    while(!plys.empty())
+    {
+        child.move = plys.front();
+        plys.pop();
+        child.parent = nodeIndex;
+        child.firstChild = 0;
+        child.childrenAmount = 0;
+        child.nPlysRest = nPlysRest;
+        child.isExpanded = false;
+        
+        desk.makeMoveAhead(child.move, true);
+        evaluateProofNode(&child);
+        desk.makeMoveBack(true);
+        
+        proofNodes.push_back(child);
+    }
+    
+    proofNode *node = &proofNodes[nodeIndex];
+    node->firstChild = firstChild;
+    node->childrenAmount = proofNodes.size() - firstChild;
+    node->isExpanded = true;
+    
+    return true;
+}
+
+void Chess::updateProofNumbers(proofNode *const node)
+{
+    //Узел "или": доказательство - минимум по детям, опровержение - сумма;
+    //узел "и" - наоборот. Суммы ограничиваются "бесконечностью"
+    assert(node->isExpanded);
+    bool isOrNode = ((node->nPlysRest % 2) == 1);
+    int minimum = ProofInfinity;
+    long long sum = 0;
+    
+    for(int i = node->firstChild; i < node->firstChild + node->childrenAmount; i++)
+    {
+        int minimized = isOrNode ? proofNodes[i].proof : proofNodes[i].disproof;
+        int summed = isOrNode ? proofNodes[i].disproof : proofNodes[i].proof;
+        if(minimized < minimum){minimum = minimized;}
+        sum += summed;
+    }
+    if(sum > ProofInfinity){sum = ProofInfinity;}
+    
+    if(isOrNode)
+    {
+        node->proof = minimum;
+        node->disproof = (int)sum;
+    }
+    else
+    {
+        node->proof = (int)sum;
+        node->disproof = minimum;
+    }
+}
+
+int Chess::computeProofNumber(solutionVisitor * const visitor)
+{
+    assert(desk.getIsWhiteTurn());
+    const unsigned long long allocationsAmount = getHeapAllocationsAmount();
+    nodesAmount = 0;
+    //задача без ходов (loadChessProblem с nMoves < 1) - решений нет
+    if(totalPlys < 1){return 0;}
+    
+    proofNodes.clear();
+    
+    proofNode root;
+    root.parent = -1;
+    root.firstChild = 0;
+    root.childrenAmount = 0;
+    root.nPlysRest = totalPlys;
+    root.isExpanded = false;
+    evaluateProofNode(&root);
+    proofNodes.push_back(root);
+    
+    bool isLimitReached = false;
+    int nodeIndex = 0;
+    int bestChild = 0;
+    bool isOrNode = false;
+    
+    while(proofNodes[0].proof != 0 && proofNodes[0].disproof != 0)
+    {
+        //спуск к наиболее доказывающему узлу: в узле "или" - к ребенку
+        //с минимальным числом доказательства, в узле "и" - с минимальным
+        //числом опровержения
+        nodeIndex = 0;
+        while(proofNodes[nodeIndex].isExpanded)
+        {
+            proofNode *node = &proofNodes[nodeIndex];
+            isOrNode = ((node->nPlysRest % 2) == 1);
+            bestChild = node->firstChild;
+            for(int i = node->firstChild; i < node->firstChild + node->childrenAmount; i++)
+            {
+                if(isOrNode ? (proofNodes[i].proof < proofNodes[bestChild].proof) :
+                              (proofNodes[i].disproof < proofNodes[bestChild].disproof))
+                    {bestChild = i;}
+            }
+            desk.makeMoveAhead(proofNodes[bestChild].move, true);
+            nodeIndex = bestChild;
+        }
+        
+        if(!expandProofNode(nodeIndex)){isLimitReached = true;}
+        
+        //пересчет чисел на пути к корню с возвратом ходов
+        while(nodeIndex != 0)
+        {
+            if(proofNodes[nodeIndex].isExpanded){updateProofNumbers(&proofNodes[nodeIndex]);}
+            desk.makeMoveBack(true);
+            nodeIndex = proofNodes[nodeIndex].parent;
+        }
+        if(proofNodes[0].isExpanded){updateProofNumbers(&proofNodes[0]);}
+        
+        if(isLimitReached){break;}
+    }
+    
+    solutionNodes.clear();
+    int solutions = NoSolutionNode;
+    if(proofNodes[0].proof == 0){solutions = collectProofPaths(0);}
+    
+    searchAllocationsAmount = getHeapAllocationsAmount() - allocationsAmount;
+    nodesAmount = proofNodes.size();
+    if(isPrinting)
+    {
+        printf("\nPROOF NODES: %d\n", (int)proofNodes.size());
+        if(isLimitReached){printf("proof nodes limit reached.\n");}
+        printf("\n%d\nPATHS:\n", getSolutionPathsAmount(solutions));
+    }
+    
+    if(visitor != NULL)
+    {
+        plyForOut path[MaxPlys];
+        visitSolutions(solutions, path, 0, visitor);
+    }
+    
+    if(isLimitReached){return -1;}
+    return (proofNodes[0].proof == 0) ? 1 : 0;
+}
+
+int Chess::collectProofPaths(const int nodeIndex)
+{
+    //Дерево решений из дерева доказательства: в узле "или" - первый
+    //доказанный ход белых, в узле "и" - все ходы черных.
+    //Возвращает цепочку продолжений узла nodeIndex.
+    const proofNode *node = &proofNodes[nodeIndex];
+    assert(node->proof == 0);
+    
+    //не раскрытый доказанный узел - мат черным
+    if(!node->isExpanded){return NoSolutionNode;}
+    
+    int first = NoSolutionNode;
+    int last = NoSolutionNode;
+    bool isOrNode = ((node->nPlysRest % 2) == 1);
+    for(int i = node->firstChild; i < node->firstChild + node->childrenAmount; i++)
+    {
+        if(proofNodes[i].proof != 0){continue;}
+        
+        addSolutionNode(proofNodes[i].move, collectProofPaths(i), &first, &last);
+        
+        if(isOrNode){break;}
+    }
+    return first;
+}
+
+void Chess::addSolutionNode(const PackedPly move, const int firstChild,
+                            int *const first, int *const last)
+{
+    solutionNode node;
+    node.move = move;
+    node.firstChild = firstChild;
+    node.nextSibling = NoSolutionNode;
+    solutionNodes.push_back(node);
+    
+    const int nodeIndex = (int)solutionNodes.size() - 1;
+    if(*first == NoSolutionNode)
+        {*first = nodeIndex;}
+    else
+        {solutionNodes[*last].nextSibling = nodeIndex;}
+    *last = nodeIndex;
+}
+
+int Chess::getSolutionPathsAmount(const int firstSolution)
+{
+    //число листьев дерева решений
+    int pathsAmount = 0;
+    for(int i = firstSolution; i != NoSolutionNode; i = solutionNodes[i].nextSibling)
+    {
+        if(solutionNodes[i].firstChild == NoSolutionNode)
+            {pathsAmount++;}
+        else
+            {pathsAmount += getSolutionPathsAmount(solutionNodes[i].firstChild);}
+    }
+    return pathsAmount;
+}
+
+Chess::plyForOut Chess::getPlyForOut(const PackedPly ply, const int plyNo)
+{
+    plyForOut plyOuter;
+    plyOuter.plyNo = plyNo;
+    plyOuter.pieceType = ply.getMovingPieceType();
+    plyOuter.xSourceField = ply.getXSourceField();
+    plyOuter.ySourceField = ply.getYSourceField();
+    plyOuter.xDestinationField = ply.getXDestinationField();
+    plyOuter.yDestinationField = ply.getYDestinationField();
+    plyOuter.whichPieceIfPromotion = ply.getWhichPieceIfPromotion();
+    plyOuter.isCastling = ply.getIsCastling();
+    //задача с ходом черных решалась отраженной - полуход выдается
+    //в обозначениях исходной задачи
+    if(isColorsSwapped)
+    {
+        plyOuter.pieceType = getSwappedPieceType(plyOuter.pieceType);
+        plyOuter.ySourceField = DeskSizeY - plyOuter.ySourceField + 1;
+        plyOuter.yDestinationField = DeskSizeY - plyOuter.yDestinationField + 1;
+        plyOuter.whichPieceIfPromotion = getSwappedPieceType(plyOuter.whichPieceIfPromotion);
+    }
+    plyOuter.pieceSymbol = Chess::getPieceSymbol(plyOuter.pieceType);
+    return plyOuter;
+}
+
+void Chess::visitSolutions(const int firstSolution, plyForOut *const path,
+                           const int pathLength, solutionVisitor * const visitor)
+{
+    //путь до узла лежит в буфере, при достижении листа он выдается visitor
+    assert(pathLength < MaxPlys);
+    for(int i = firstSolution; i != NoSolutionNode; i = solutionNodes[i].nextSibling)
+    {
+        path[pathLength] = getPlyForOut(solutionNodes[i].move, pathLength);
+        if(solutionNodes[i].firstChild == NoSolutionNode)
+            {visitor->visitPath(path, pathLength + 1);}
+        else
+            {visitSolutions(solutionNodes[i].firstChild, path, pathLength + 1, visitor);}
+    }
+}
+
+//Получатель, собирающий пути в список
+class solutionsCollector : public Chess::solutionVisitor
+{
+    public:
+        explicit solutionsCollector(std::list< std::list<Chess::plyForOut> > * const solutions)
+        : solutions(solutions) {}
+        
+        void visitPath(const Chess::plyForOut * const path, const int pathLength)
+        {solutions->push_back(std::list<Chess::plyForOut>(path, path + pathLength));}
+        
+    private:
+        std::list< std::list<Chess::plyForOut> > *solutions;
+};
+
+int Chess::compute(std::list< std::list<plyForOut> > * const solutionsForOut)
+{
+    solutionsCollector collector(solutionsForOut);
+    return compute(solutionsForOut != NULL ? &collector : NULL);
+}
+
+int Chess::computeShortest(std::list< std::list<plyForOut> > * const solutionsForOut)
+{
+    solutionsCollector collector(solutionsForOut);
+    return computeShortest(solutionsForOut != NULL ? &collector : NULL);
+}
+
+int Chess::computeKeys(std::list< std::list<plyForOut> > * const solutionsForOut,
+                       const bool isCooksCounting)
+{
+    solutionsCollector collector(solutionsForOut);
+    return computeKeys(solutionsForOut != NULL ? &collector : NULL, isCooksCounting);
+}
+
+int Chess::computeProofNumber(std::list< std::list<plyForOut> > * const solutionsForOut)
+{
+    solutionsCollector collector(solutionsForOut);
+    return computeProofNumber(solutionsForOut != NULL ? &collector : NULL);
+}
+
+bool Chess::testGenerator(FILE * const expectedPlys)
+{
+    computeTest();
+    loadTestOut(expectedPlys);
+    return test();
+}
+
+bool Chess::test()
+{
+    std::list<PackedPly>::iterator i = testing.begin();
+     std::list<PackedPly>::iterator j = testingOut.begin();
+     
+    if(!testingOut.empty() && !testing.empty())
+    {
+        for(i, j; j != testingOut.end(); ++i, ++j)
+        {
+            if(i == testing.end()){return false;}
+            
+            if(i->getSourceSquare() != j->getSourceSquare() ||
+               i->getDestinationSquare() != j->getDestinationSquare() ||
+               i->getWhichPieceIfTaking() != j->getWhichPieceIfTaking() ||
+               i->getWhichPieceIfPromotion() != j->getWhichPieceIfPromotion() ||
+               i->getIsCastling() != j->getIsCastling())
+                {return false;}
+        }
+        if(i != testing.end()){return false;}
+    }
+    else{return false;}
+        
+    return true;
+}
+
+
+
+
+
+
+
+static inline const char *skipSpaces(const char *text)
+{
+    while(*text == ' ' || *text == '\t'){text++;}
+    return text;
+}
+
+static inline bool getIsFieldEnd(const char c)
+{return c == ' ' || c == '\t' || c == '\0' || c == '\r' || c == '\n';}
+
+static inline bool getIsSpace(const char c)
+{return c == ' ' || c == '\t' || c == '\r' || c == '\n';}
+
+int getPieceTypeFromFen(const char symbol)
+{
+    switch(symbol)
+    {
+        case 'K': return Chess::WhiteKing;
+        case 'Q': return Chess::WhiteQueen;
+        case 'R': return Chess::WhiteRook;
+        case 'N': return Chess::WhiteKNight;
+        case 'B': return Chess::WhiteBishop;
+        case 'P': return Chess::WhitePawn;
+        case 'k': return Chess::BlackKing;
+        case 'q': return Chess::BlackQueen;
+        case 'r': return Chess::BlackRook;
+        case 'n': return Chess::BlackKNight;
+        case 'b': return Chess::BlackBishop;
+        case 'p': return Chess::BlackPawn;
+    }
+    return Chess::Empty;
+}
+
+//Целое число из текста до end; пробелы и переводы строки перед ним пропускаются
+static inline bool readNumber(const char **text, const char * const end, int * const number)
+{
+    const char *c = *text;
+    while(c < end && getIsSpace(*c)){c++;}
+    bool isNegative = (c < end && *c == '-');
+    if(isNegative){c++;}
+    if(c == end || *c < '0' || *c > '9'){return false;}
+    int value = 0;
+    for(; c < end && *c >= '0' && *c <= '9'; c++)
+    {
+        value = value * 10 + (*c - '0');
+        if(value > 1000000){return false;}
+    }
+    *number = isNegative ? -value : value;
+    *text = c;
+    return true;
+}
+
+//Пропуск целого числа (для индекса набора задач - без проверки значения)
+static inline bool skipNumber(const char **text, const char * const end)
+{
+    const char *c = *text;
+    while(c < end && getIsSpace(*c)){c++;}
+    if(c < end && *c == '-'){c++;}
+    if(c == end || *c < '0' || *c > '9'){return false;}
+    while(c < end && *c >= '0' && *c <= '9'){c++;}
+    *text = c;
+    return true;
+}
+
+//Разбор строки FEN или EPD: расстановка, очередь хода, права на рокировку,
+//поле взятия на проходе, далее счетчики ходов FEN или операции EPD
+//("dm 3; id \"...\";"). Строка (до '\0' или перевода строки) не копируется
+//и не изменяется
+bool parseFen(const char * const text, parsedProblem * const problem)
+{
+    problem->piecesAmount = 0;
+    problem->id = NULL;
+    problem->idLength = 0;
+    problem->nMoves = NoMovesAmount;
+    problem->castlingPermits = 0;
+    problem->isEnPassantPossible = false;
+    problem->xPawnPosIfEnPassant = 0;
+    problem->yPawnPosIfEnPassant = 0;
+    
+    //расстановка - от восьмой горизонтали к первой, внутри - от a к h
+    int desk[Chess::DeskSizeX + 1][Chess::DeskSizeY + 1] = {};
+    int whiteKingsAmount = 0;
+    int blackKingsAmount = 0;
+    int x = 1;
+    int y = Chess::DeskSizeY;
+    const char *c = skipSpaces(text);
+    for(; !getIsFieldEnd(*c); c++)
+    {
+        if(*c == '/')
+        {
+            if(x != Chess::DeskSizeX + 1 || y == 1){return false;}
+            x = 1;
+            y--;
+            continue;
+        }
+        if(*c >= '1' && *c <= '8')
+        {
+            x += *c - '0';
+            if(x > Chess::DeskSizeX + 1){return false;}
+            continue;
+        }
+        int pieceType = getPieceTypeFromFen(*c);
+        if(pieceType == Chess::Empty || x > Chess::DeskSizeX){return false;}
+        if((pieceType == Chess::WhitePawn || pieceType == Chess::BlackPawn) &&
+           (y == 1 || y == Chess::DeskSizeY))
+            {return false;}
+        if(pieceType == Chess::WhiteKing){whiteKingsAmount++;}
+        if(pieceType == Chess::BlackKing){blackKingsAmount++;}
+        
+        desk[x][y] = pieceType;
+        Chess::pieceForIn *inputPiece = &problem->pieces[problem->piecesAmount++];
+        inputPiece->pieceType = pieceType;
+        inputPiece->xPosition = x;
+        inputPiece->yPosition = y;
+        x++;
+    }
+    if(x != Chess::DeskSizeX + 1 || y != 1 ||
+       whiteKingsAmount != 1 || blackKingsAmount != 1)
+        {return false;}
+    
+    //очередь хода
+    c = skipSpaces(c);
+    if((*c != 'w' && *c != 'b') || !getIsFieldEnd(c[1])){return false;}
+    problem->isWhiteFirst = (*c == 'w');
+    c++;
+    
+    //права на рокировку
+    c = skipSpaces(c);
+    if(*c == '-'){c++;}
+    else
+    {
+        for(; !getIsFieldEnd(*c); c++)
+        {
+            switch(*c)
+            {
+                case 'K': problem->castlingPermits |= 1; break;
+                case 'Q': problem->castlingPermits |= 2; break;
+                case 'k': problem->castlingPermits |= 4; break;
+                case 'q': problem->castlingPermits |= 8; break;
+                default: return false;
+            }
+        }
+    }
+    
+    //поле взятия на проходе; в движке отмечается сама пешка, сходившая
+    //на два поля, и только если она действительно стоит на доске
+    c = skipSpaces(c);
+    if(*c == '-'){c++;}
+    else
+    {
+        if(c[0] < 'a' || c[0] > 'h' || (c[1] != '3' && c[1] != '6')){return false;}
+        int xPawn = c[0] - 'a' + 1;
+        int yPawn = (c[1] == '6' ? 5 : 4);
+        int pawnType = (c[1] == '6' ? Chess::BlackPawn : Chess::WhitePawn);
+        if(desk[xPawn][yPawn] == pawnType && problem->isWhiteFirst == (c[1] == '6'))
+        {
+            problem->isEnPassantPossible = true;
+            problem->xPawnPosIfEnPassant = xPawn;
+            problem->yPawnPosIfEnPassant = yPawn;
+        }
+        c += 2;
+    }
+    if(!getIsFieldEnd(*c)){return false;}
+    
+    //счетчики ходов FEN пропускаются, операции EPD - "код операнды;"
+    c = skipSpaces(c);
+    while(*c != '\0' && *c != '\r' && *c != '\n')
+    {
+        const char *opcode = c;
+        while(!getIsFieldEnd(*c) && *c != ';'){c++;}
+        size_t opcodeLength = c - opcode;
+        if(*opcode >= '0' && *opcode <= '9')
+        {
+            c = skipSpaces(c);
+            continue;
+        }
+        
+        c = skipSpaces(c);
+        const char *operand = c;
+        bool isQuoted = false;
+        while(*c != '\0' && *c != '\r' && *c != '\n' && (*c != ';' || isQuoted))
+        {
+            if(*c == '"'){isQuoted = !isQuoted;}
+            c++;
+        }
+        const char *operandEnd = c;
+        while(operandEnd > operand && (operandEnd[-1] == ' ' || operandEnd[-1] == '\t'))
+            {operandEnd--;}
+        if(*c == ';'){c++;}
+        c = skipSpaces(c);
+        
+        if(opcodeLength == 2 && strncmp(opcode, "dm", 2) == 0)
+        {
+            //слишком большое число - не ошибка разбора: такая задача
+            //отклоняется при загрузке, как и любое недопустимое число ходов
+            const char *number = operand;
+            if(!readNumber(&number, operandEnd, &problem->nMoves))
+            {
+                if(!skipNumber(&number, operandEnd)){return false;}
+                problem->nMoves = Chess::MaxPlys;
+            }
+            if(number != operandEnd || problem->nMoves < 1){return false;}
+        }
+        else if(opcodeLength == 2 && strncmp(opcode, "id", 2) == 0)
+        {
+            if(operandEnd - operand >= 2 && *operand == '"' && operandEnd[-1] == '"')
+            {
+                operand++;
+                operandEnd--;
+            }
+            problem->id = operand;
+            problem->idLength = (int)(operandEnd - operand);
+        }
     }
-    assert(f != 0);
     
-    //int totalAmount = 0;
+    return true;
+}
+
+//Разбор задачи целочисленного формата "P W B" + W + B строк "A X Y",
+//начинающейся в text; next (может быть NULL) - конец задачи в тексте
+bool parseIntegerProblem(const char * const text, const char * const end,
+                         parsedProblem * const problem, const char ** const next)
+{
+    const char *c = text;
     int nMoves;
     int whiteAmount = 0;
     int blackAmount = 0;
-    int pId = 0, xPosition = 0, yPosition = 0;
-    bool isWhiteFirst = true;
-    bool isEnPassantPossible = false;
-    int yPawnPosIfEnPassant = 0;
-    int xPawnPosIfEnPassant = 0;
-    Chess::pieceForIn inputPiece;
-    std::list<Chess::pieceForIn> pieces;
-    int fErr = 0;
-    
-    fErr = fscanf(f, "%d", &nMoves);
-    assert(fErr == 1);
-    //fErr = fscanf(f, "%d", &isWhiteFirst);
-    assert(fErr == 1);
-    isWhiteFirst = true;
-    fErr = fscanf(f, "%d", &whiteAmount);
-    assert(fErr == 1);
-    fErr = fscanf(f, "%d", &blackAmount);
-    assert(fErr == 1);
-    //printf("%d ", whiteAmount); 
-    //printf("%d\n", blackAmount); 
-    nMoves = nMoves;
-    
-    if(isMirror)
-        isWhiteFirst = !isWhiteFirst;
     
-    int i = 0;
+    problem->isWhiteFirst = true;
+    problem->castlingPermits = Chess::CastlingByPosition;
+    problem->isEnPassantPossible = false;
+    problem->xPawnPosIfEnPassant = 0;
+    problem->yPawnPosIfEnPassant = 0;
+    problem->id = NULL;
+    problem->idLength = 0;
+    problem->piecesAmount = 0;
+    
+    //в пакетном режиме файлы не проверены - ошибка формата не должна
+    //приводить к падению, задача просто не загружается
+    if(!readNumber(&c, end, &nMoves) || !readNumber(&c, end, &whiteAmount) ||
+       !readNumber(&c, end, &blackAmount) ||
+       !getIsMovesAmountAllowed(nMoves) ||
+       whiteAmount < 1 || blackAmount < 1 ||
+       whiteAmount + blackAmount > Chess::DeskSizeX * Chess::DeskSizeY)
+        {return false;}
+    problem->nMoves = nMoves;
+    
+    int whiteKingsAmount = 0;
+    int blackKingsAmount = 0;
     int iMax = whiteAmount + blackAmount;
-    for(i = 0; i < iMax; i++)
+    for(int i = 0; i < iMax; i++)
     {
-        fErr = fscanf(f, "%d", &pId);
-        assert(fErr == 1);
-        fErr = fscanf(f, "%d", &xPosition);
-        assert(fErr == 1);
-        fErr = fscanf(f, "%d", &yPosition);
-        assert(fErr == 1);
-        //printf("%d %d %d\n", p,x,y);
-        if(fErr != 1){printf("incorrect input, check input file.\n");}
+        int pId = 0, xPosition = 0, yPosition = 0;
+        if(!readNumber(&c, end, &pId) || !readNumber(&c, end, &xPosition) ||
+           !readNumber(&c, end, &yPosition) || pId < 1 || pId > 7 ||
+           xPosition < 1 || xPosition > Chess::DeskSizeX ||
+           yPosition < 1 || yPosition > Chess::DeskSizeY)
+            {return false;}
+        if(pId == 1)
+        {
+            if(i < whiteAmount){whiteKingsAmount++;}
+            else{blackKingsAmount++;}
+        }
         
         if(pId == 7)
         {
             //пешка, только что сходившая двухшаговый
-            isEnPassantPossible = true;
-            xPawnPosIfEnPassant = xPosition;
-            yPawnPosIfEnPassant = yPosition;
+            problem->isEnPassantPossible = true;
+            problem->xPawnPosIfEnPassant = xPosition;
+            problem->yPawnPosIfEnPassant = yPosition;
             pId = 6;
-            if(isMirror)
-            {
-                yPawnPosIfEnPassant = Chess::DeskSizeY - yPosition + 1;
-            }
         }
+        if(i >= whiteAmount){pId = pId + Chess::BlackIdSum;}
+        
+        Chess::pieceForIn *inputPiece = &problem->pieces[problem->piecesAmount++];
+        inputPiece->pieceType = pId;
+        inputPiece->xPosition = xPosition;
+        inputPiece->yPosition = yPosition;
+    }
+    if(whiteKingsAmount != 1 || blackKingsAmount != 1){return false;}
+    
+    if(next != NULL){*next = c;}
+    return true;
+}
+
+//Зеркальная задача: цвета меняются местами, доска отражается по горизонтали
+void mirrorProblem(parsedProblem * const problem)
+{
+    problem->isWhiteFirst = !problem->isWhiteFirst;
+    if(problem->castlingPermits != Chess::CastlingByPosition)
+    {
+        problem->castlingPermits = ((problem->castlingPermits & 3) << 2) |
+                                   ((problem->castlingPermits >> 2) & 3);
+    }
+    if(problem->isEnPassantPossible)
+        {problem->yPawnPosIfEnPassant = Chess::DeskSizeY - problem->yPawnPosIfEnPassant + 1;}
+    for(int i = 0; i < problem->piecesAmount; i++)
+    {
+        Chess::pieceForIn *piece = &problem->pieces[i];
+        piece->yPosition = Chess::DeskSizeY - piece->yPosition + 1;
+        if(piece->pieceType > Chess::BlackIdSum){piece->pieceType -= Chess::BlackIdSum;}
+        else{piece->pieceType += Chess::BlackIdSum;}
+    }
+}
+
+//Загрузка разобранной задачи. Число ходов, если не задано, - defaultMoves;
+//false - число ходов не задано или недопустимо. Задача с ходом черных
+//загружается отраженной (решатели считают, что первыми ходят белые),
+//решение выдается в обозначениях исходной задачи. isMirror - загрузка
+//с ходом черных (для отладки генератора полуходов)
+bool loadParsedProblem(parsedProblem * const problem, Chess * const chess,
+                       const bool isMirror, const int defaultMoves)
+{
+    if(problem->nMoves == NoMovesAmount)
+    {
+        if(defaultMoves < 1){return false;}
+        problem->nMoves = defaultMoves;
+    }
+    if(!getIsMovesAmountAllowed(problem->nMoves)){return false;}
+    bool isColorsSwapped = isMirror ? problem->isWhiteFirst : !problem->isWhiteFirst;
+    if(isColorsSwapped){mirrorProblem(problem);}
+    
+    chess->loadChessProblem(problem->isWhiteFirst, problem->isEnPassantPossible,
+                            problem->xPawnPosIfEnPassant, problem->yPawnPosIfEnPassant,
+                            problem->castlingPermits, problem->nMoves,
+                            problem->pieces, problem->piecesAmount);
+    chess->setIsColorsSwapped(isColorsSwapped && !isMirror);
+    return true;
+}
+
+//Загрузка задачи из строки FEN/EPD. Число ходов - из операции "dm",
+//при ее отсутствии - defaultMoves (0 - задача без "dm" не загружается).
+//id может быть NULL
+bool loadChessProblemFromFen(const char * const text, Chess * const chess,
+                             const bool isMirror, const int defaultMoves,
+                             std::string * const id)
+{
+    parsedProblem problem;
+    if(!parseFen(text, &problem))
+    {
+        printf("incorrect FEN/EPD: %s\n", text);
+        return false;
+    }
+    if(id != NULL){id->assign(problem.id, problem.idLength);}
+    if(problem.nMoves == NoMovesAmount && defaultMoves < 1)
+    {
+        printf("incorrect input, FEN/EPD needs the \"dm\" operation (or -dm).\n");
+        return false;
+    }
+    if(!loadParsedProblem(&problem, chess, isMirror, defaultMoves))
+    {
+        printf("incorrect input, too many moves (at most %d).\n", Chess::MaxPlys / 2);
+        return false;
+    }
+    return true;
+}
+
+static const char BinaryProblemMagic[8] = {'C', 'H', 'P', 'R', 'P', 'R', 'O', 'B'};
+static const char BinaryResultMagic[8] = {'C', 'H', 'P', 'R', 'R', 'S', 'L', 'T'};
+
+static inline void putUint32(unsigned char * const bytes, const unsigned int value)
+{
+    for(int i = 0; i < 4; i++){bytes[i] = (unsigned char)(value >> (8 * i));}
+}
+
+static inline void putUint64(unsigned char * const bytes, const unsigned long long value)
+{
+    for(int i = 0; i < 8; i++){bytes[i] = (unsigned char)(value >> (8 * i));}
+}
+
+static inline unsigned int getUint32(const unsigned char * const bytes)
+{
+    unsigned int value = 0;
+    for(int i = 3; i >= 0; i--){value = (value << 8) | bytes[i];}
+    return value;
+}
+
+static inline unsigned long long getUint64(const unsigned char * const bytes)
+{
+    unsigned long long value = 0;
+    for(int i = 7; i >= 0; i--){value = (value << 8) | bytes[i];}
+    return value;
+}
+
+bool writeBinaryHeader(FILE * const f, const BinaryFileType type)
+{
+    unsigned char header[BinaryHeaderSize];
+    memcpy(header, type == BinaryResultsFile ? BinaryResultMagic : BinaryProblemMagic, 8);
+    putUint32(header + 8, BinaryVersion);
+    putUint32(header + 12, type == BinaryResultsFile ? BinaryResultSize : BinaryProblemSize);
+    return fwrite(header, 1, sizeof(header), f) == sizeof(header);
+}
+
+//Проверка заголовка в начале данных
+bool getIsBinaryHeader(const char * const data, const size_t size, const BinaryFileType type)
+{
+    const unsigned char *header = (const unsigned char *)data;
+    const char *magic = type == BinaryResultsFile ? BinaryResultMagic : BinaryProblemMagic;
+    int recordSize = type == BinaryResultsFile ? BinaryResultSize : BinaryProblemSize;
+    return size >= BinaryHeaderSize && memcmp(data, magic, 8) == 0 &&
+           getUint32(header + 8) == BinaryVersion &&
+           getUint32(header + 12) == (unsigned int)recordSize;
+}
+
+bool writeBinaryProblem(FILE * const f, const parsedProblem * const problem)
+{
+    unsigned char record[BinaryProblemSize] = {};
+    for(int i = 0; i < problem->piecesAmount; i++)
+    {
+        const Chess::pieceForIn *piece = &problem->pieces[i];
+        int square = (piece->yPosition - 1) * Chess::DeskSizeX + piece->xPosition - 1;
+        int code = piece->pieceType > Chess::BlackIdSum ?
+                   piece->pieceType - Chess::BlackIdSum + 8 : piece->pieceType;
+        record[square / 2] |= (unsigned char)(code << (4 * (square % 2)));
+    }
+    
+    unsigned char flags = 0;
+    if(problem->isWhiteFirst){flags |= BinaryWhiteFirst;}
+    if(problem->castlingPermits == Chess::CastlingByPosition){flags |= BinaryCastlingByPosition;}
+    else{flags |= (unsigned char)(problem->castlingPermits << BinaryCastlingShift);}
+    if(problem->isEnPassantPossible)
+    {
+        flags |= BinaryEnPassant;
+        record[33] = (unsigned char)((problem->yPawnPosIfEnPassant - 1) * Chess::DeskSizeX +
+                                     problem->xPawnPosIfEnPassant - 1);
+    }
+    record[32] = flags;
+    record[34] = (unsigned char)(problem->nMoves > 0 ? problem->nMoves : 0);
+    
+    return fwrite(record, 1, sizeof(record), f) == sizeof(record);
+}
+
+bool parseBinaryProblem(const unsigned char * const record, parsedProblem * const problem)
+{
+    problem->piecesAmount = 0;
+    problem->id = NULL;
+    problem->idLength = 0;
+    
+    int whiteKingsAmount = 0;
+    int blackKingsAmount = 0;
+    for(int square = 0; square < Chess::DeskSizeX * Chess::DeskSizeY; square++)
+    {
+        int code = (record[square / 2] >> (4 * (square % 2))) & 0xF;
+        if(code == 0){continue;}
+        if((code & 7) < 1 || (code & 7) > Chess::AmountTypesOfPieces){return false;}
+        if(code == Chess::WhiteKing){whiteKingsAmount++;}
+        if(code == Chess::BlackKing - Chess::BlackIdSum + 8){blackKingsAmount++;}
         
-        if(i < whiteAmount)
+        Chess::pieceForIn *piece = &problem->pieces[problem->piecesAmount++];
+        piece->pieceType = code > 8 ? code - 8 + Chess::BlackIdSum : code;
+        piece->xPosition = square % Chess::DeskSizeX + 1;
+        piece->yPosition = square / Chess::DeskSizeX + 1;
+    }
+    if(whiteKingsAmount != 1 || blackKingsAmount != 1){return false;}
+    
+    unsigned char flags = record[32];
+    problem->isWhiteFirst = (flags & BinaryWhiteFirst) != 0;
+    problem->castlingPermits = (flags & BinaryCastlingByPosition) ? Chess::CastlingByPosition :
+                               (flags >> BinaryCastlingShift) & 0xF;
+    problem->isEnPassantPossible = (flags & BinaryEnPassant) != 0;
+    problem->xPawnPosIfEnPassant = 0;
+    problem->yPawnPosIfEnPassant = 0;
+    if(problem->isEnPassantPossible)
+    {
+        if(record[33] >= Chess::DeskSizeX * Chess::DeskSizeY){return false;}
+        problem->xPawnPosIfEnPassant = record[33] % Chess::DeskSizeX + 1;
+        problem->yPawnPosIfEnPassant = record[33] / Chess::DeskSizeX + 1;
+    }
+    problem->nMoves = record[34] > 0 ? record[34] : NoMovesAmount;
+    return true;
+}
+
+bool writeBinaryResult(FILE * const f, const binaryResult * const result)
+{
+    unsigned char record[BinaryResultSize] = {};
+    putUint32(record, (unsigned int)result->index);
+    record[4] = (unsigned char)result->status;
+    record[5] = (unsigned char)result->mode;
+    if(result->keysAmount > 0)
+    {
+        record[6] = (unsigned char)result->key.pieceSymbol;
+        record[7] = (unsigned char)((result->key.ySourceField - 1) * Chess::DeskSizeX +
+                                    result->key.xSourceField - 1);
+        record[8] = (unsigned char)((result->key.yDestinationField - 1) * Chess::DeskSizeX +
+                                    result->key.xDestinationField - 1);
+    }
+    record[9] = (unsigned char)std::min(result->keysAmount, 255);
+    putUint32(record + 12, (unsigned int)result->result);
+    putUint64(record + 16, result->nodes);
+    putUint64(record + 24, result->microseconds);
+    
+    return fwrite(record, 1, sizeof(record), f) == sizeof(record);
+}
+
+void parseBinaryResult(const unsigned char * const record, binaryResult * const result)
+{
+    result->index = (int)getUint32(record);
+    result->status = record[4];
+    result->mode = record[5];
+    result->keysAmount = record[9];
+    result->key = Chess::plyForOut();
+    if(result->keysAmount > 0)
+    {
+        result->key.pieceSymbol = record[6];
+        result->key.xSourceField = record[7] % Chess::DeskSizeX + 1;
+        result->key.ySourceField = record[7] / Chess::DeskSizeX + 1;
+        result->key.xDestinationField = record[8] % Chess::DeskSizeX + 1;
+        result->key.yDestinationField = record[8] / Chess::DeskSizeX + 1;
+    }
+    result->result = (int)getUint32(record + 12);
+    result->nodes = getUint64(record + 16);
+    result->microseconds = getUint64(record + 24);
+}
+
+void closeCorpus(problemCorpus * const corpus)
+{
+    #ifndef _WIN32
+        if(corpus->mapping != NULL){munmap(corpus->mapping, corpus->size);}
+    #endif
+    corpus->mapping = NULL;
+    corpus->data = NULL;
+    corpus->size = 0;
+    std::vector<char>().swap(corpus->buffer);
+    std::vector<size_t>().swap(corpus->offsets);
+}
+
+//Файл в памяти. Разбор текста опирается на перевод строки в конце данных:
+//если его нет (или отображение недоступно), файл читается в буфер
+//с добавленным переводом строки. Двоичный файл отображается как есть
+bool mapCorpusFile(const std::string fileName, problemCorpus * const corpus)
+{
+    corpus->mapping = NULL;
+    #ifndef _WIN32
+        int fd = open(fileName.c_str(), O_RDONLY);
+        if(fd < 0){return false;}
+        struct stat fileStat;
+        if(fstat(fd, &fileStat) == 0 && S_ISREG(fileStat.st_mode) && fileStat.st_size > 0)
         {
-            if(isMirror)
+            size_t size = (size_t)fileStat.st_size;
+            void *mapping = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+            if(mapping != MAP_FAILED)
             {
-                yPosition = Chess::DeskSizeY - yPosition + 1;
-                pId = pId + Chess::BlackIdSum;
+                madvise(mapping, size, MADV_SEQUENTIAL);
+                if(((const char *)mapping)[size - 1] == '\n' ||
+                   getIsBinaryHeader((const char *)mapping, size, BinaryProblemsFile) ||
+                   getIsBinaryHeader((const char *)mapping, size, BinaryResultsFile))
+                {
+                    close(fd);
+                    corpus->mapping = mapping;
+                    corpus->data = (const char *)mapping;
+                    corpus->size = size;
+                    return true;
+                }
+                munmap(mapping, size);
             }
         }
-        else
-        {    
-            if(isMirror)
-            {
-                yPosition = Chess::DeskSizeY - yPosition + 1;
-            }
-            else
-            {
-                pId = pId + Chess::BlackIdSum;
-            }
+        close(fd);
+    #endif
+    
+    FILE *f = fopen(fileName.c_str(), "rb");
+    if(f == 0){return false;}
+    char block[1 << 16];
+    size_t readAmount;
+    while((readAmount = fread(block, 1, sizeof(block), f)) > 0)
+        {corpus->buffer.insert(corpus->buffer.end(), block, block + readAmount);}
+    fclose(f);
+    corpus->buffer.push_back('\n');
+    corpus->data = &corpus->buffer[0];
+    corpus->size = corpus->buffer.size();
+    return true;
+}
+
+bool openCorpus(const std::string fileName, problemCorpus * const corpus)
+{
+    corpus->fileName = fileName;
+    corpus->offsets.clear();
+    if(!mapCorpusFile(fileName, corpus)){return false;}
+    
+    const char *data = corpus->data;
+    const char *end = data + corpus->size;
+    
+    if(getIsBinaryHeader(data, corpus->size, BinaryProblemsFile))
+    {
+        corpus->format = BinaryCorpus;
+        return true;
+    }
+    
+    //формат текста - по первому полю: FEN содержит '/'; '#' - комментарий EPD
+    const char *c = data;
+    while(c < end && getIsSpace(*c)){c++;}
+    corpus->format = (c < end && *c == '#') ? FenCorpus : IntegerCorpus;
+    for(; c < end && !getIsSpace(*c); c++)
+    {
+        if(*c == '/'){corpus->format = FenCorpus;}
+    }
+    
+    if(corpus->format == FenCorpus)
+    {
+        //строка - задача; пустые строки и строки с '#' пропускаются
+        for(c = data; c < end;)
+        {
+            const char *lineEnd = (const char *)memchr(c, '\n', end - c);
+            const char *text = skipSpaces(c);
+            if(*text != '\n' && *text != '\r' && *text != '#')
+                {corpus->offsets.push_back(text - data);}
+            c = lineEnd + 1;
+        }
+    }
+    else
+    {
+        //задачи подряд; границу следующей задачи дает разбор заголовка,
+        //фигуры только пропускаются. Нарушенный формат - последняя задача
+        for(c = data;;)
+        {
+            while(c < end && getIsSpace(*c)){c++;}
+            if(c == end){break;}
+            corpus->offsets.push_back(c - data);
+            
+            int nMoves, whiteAmount, blackAmount;
+            if(!readNumber(&c, end, &nMoves) || !readNumber(&c, end, &whiteAmount) ||
+               !readNumber(&c, end, &blackAmount) || whiteAmount < 0 || blackAmount < 0 ||
+               whiteAmount + blackAmount > Chess::DeskSizeX * Chess::DeskSizeY)
+                {break;}
+            int i = 0;
+            int iMax = (whiteAmount + blackAmount) * 3;
+            for(; i < iMax && skipNumber(&c, end); i++){}
+            if(i < iMax){break;}
         }
-        
-        inputPiece.pieceType = pId;
-        inputPiece.xPosition = xPosition;
-        inputPiece.yPosition = yPosition;
-        //добавление в список
-        pieces.push_back(inputPiece);
     }
     
-    fclose(f);
+    return true;
+}
+
+//Разбор задачи номер index прямо из данных файла
+bool parseCorpusProblem(const problemCorpus * const corpus, const size_t index,
+                        parsedProblem * const problem)
+{
+    assert(index < getCorpusProblemsAmount(corpus));
+    
+    if(corpus->format == BinaryCorpus)
+    {
+        return parseBinaryProblem((const unsigned char *)corpus->data + BinaryHeaderSize +
+                                  index * BinaryProblemSize, problem);
+    }
+    const char *text = corpus->data + corpus->offsets[index];
+    if(corpus->format == FenCorpus){return parseFen(text, problem);}
+    return parseIntegerProblem(text, corpus->data + corpus->size, problem, NULL);
+}
+
+//Загрузка задачи из файла: целочисленный формат "P W B" + "A X Y",
+//FEN/EPD (первое поле содержит '/') или двоичный; из набора задач берется первая.
+//defaultMoves - число ходов для FEN без операции "dm"
+bool loadChessProblemFromFile(const std::string fileName,
+                              Chess * const chess, const bool isMirror,
+                              const int defaultMoves)
+{
+    problemCorpus corpus;
+    if(!openCorpus(fileName, &corpus))
+    {
+        printf("File can't be open or doesn't exist (check the file name)\n");
+        return false;
+    }
     
-    chess->loadChessProblem(isWhiteFirst, isEnPassantPossible,
-                            xPawnPosIfEnPassant, yPawnPosIfEnPassant,
-                            nMoves, &pieces);
+    parsedProblem problem;
+    bool isLoaded = getCorpusProblemsAmount(&corpus) > 0 &&
+                    parseCorpusProblem(&corpus, 0, &problem) &&
+                    loadParsedProblem(&problem, chess, isMirror, defaultMoves);
+    closeCorpus(&corpus);
+    if(!isLoaded)
+    {
+        printf("incorrect input, check input file.\n");
+        return false;
+    }
     
     return true;
 }
@@ -2139,135 +3764,56 @@ void printResolution(std::list< std::list<Chess::plyForOut> > * const solutions)
         printf("\n");
 }
 
-void test1()
+//Получатель, считающий пути и передающий их дальше (next может быть NULL)
+class pathsCounter : public Chess::solutionVisitor
 {
-    std::string fileNameIn, fileNameOut, fileNameOutB;
-    for(int q = 1; q <= 6; q++)
-    {
-    
-        switch(q)
+    public:
+        explicit pathsCounter(Chess::solutionVisitor * const next)
+        : next(next), pathsAmount(0) {}
+        
+        void visitPath(const Chess::plyForOut * const path, const int pathLength)
         {
-            case 1:
-            {
-                fileNameIn = "chess_test_01.txt";
-                fileNameOut = "chess_test_01_out.txt";
-                fileNameOutB = "chess_test_01_b_out.txt";
-                break;
-            }
-            case 2:
-            {
-                fileNameIn = "chess_test_02.txt";
-                fileNameOut = "chess_test_02_out.txt";
-                fileNameOutB = "chess_test_02_b_out.txt";
-                break;
-            }
-            case 3:
-            {
-                fileNameIn = "chess_test_03.txt";
-                fileNameOut = "chess_test_03_out.txt";
-                fileNameOutB = "chess_test_03_b_out.txt";
-                break;
-            }
-            case 4:
-            {
-                fileNameIn = "chess_test_04.txt";
-                fileNameOut = "chess_test_04_out.txt";
-                fileNameOutB = "chess_test_04_b_out.txt";
-                break;
-            }
-            case 5:
-            {
-                fileNameIn = "chess_test_05.txt";
-                fileNameOut = "chess_test_05_out.txt";
-                fileNameOutB = "chess_test_05_b_out.txt";
-                break;
-            }
-            case 6:
-            {
-                fileNameIn = "chess_test_06.txt";
-                fileNameOut = "chess_test_06_out.txt";
-                fileNameOutB = "chess_test_06_b_out.txt";
-                break;
-            }
+            pathsAmount++;
+            if(next != NULL){next->visitPath(path, pathLength);}
         }
         
-        Chess problem01;
-        
-        printf(fileNameIn.c_str());
-        printf("\n");
-        loadChessProblemFromFile(fileNameIn.c_str(), &problem01, false);
-        
-        //problem01.printDesk(false, 0, 0);
+        int getPathsAmount(){return pathsAmount;}
         
-        problem01.computeTest();
+    private:
+        Chess::solutionVisitor *next;
+        int pathsAmount;
+};
+
+//Решение загруженной задачи выбранным способом; пути решения (ключи)
+//выдаются visitor (может быть NULL) обходом дерева решения после
+//доказательства (ключи - по мере доказательства).
+//Возвращает: число путей решения (для -key/-cooks - число ключей,
+//для -shortest - число ходов найденного мата), 0 - мата нет,
+//-1 - исчерпан предел узлов поиска по числам доказательства
+int solveProblem(Chess * const chess, const solveOptions * const options,
+                 Chess::solutionVisitor * const visitor)
+{
+    chess->setHashSize(options->hashMegaBytes);
+    chess->setThreadsAmount(options->threadsAmount);
+    chess->setProofNodesLimit(options->proofNodesLimit);
     
-        //problem01.printTesting();
-        
-        printf(fileNameIn.c_str());
-        printf("\n");
-        FILE *f;
-        f = fopen(fileNameOut.c_str(), "r");
-        assert(f != 0);
-        problem01.loadTestOut(f);
-        fclose(f);
-        
-        assert(problem01.test());
-        
-        Chess problem02;
-        
-        loadChessProblemFromFile(fileNameIn.c_str(), &problem02, false);
-        
-        printf(fileNameOutB.c_str());
-        printf("\n");
-        f = fopen(fileNameOutB.c_str(), "r");
-        assert(f != 0);
-        problem02.loadTestOut(f);
-        fclose(f);
-        
-        assert(problem01.test());
-            
+    if(options->isProofNumber)
+    {
+        pathsCounter counter(visitor);
+        int result = chess->computeProofNumber(&counter);
+        if(result == 1){return counter.getPathsAmount();}
+        return result;
     }
+    if(options->isKeyOnly){return chess->computeKeys(visitor, options->isCooksCounting);}
+    if(options->isShortest){return chess->computeShortest(visitor);}
+    return chess->compute(visitor);
 }
 
-
-
-int main()
+std::string getPlyText(const Chess::plyForOut &ply)
 {
-    #ifndef NDEBUG
-        printf("DEBUG MODE\n\n");
-    #endif
-    
-    #ifndef NDEBUG
-        test1();
-    #endif
-    
-    printf("WHITE: ");
-    printf("K - King; Q - Queen; R - Rook; ");
-    printf("N - kNight; B - Bishop; P - Pawn;\n");
-    printf("BlACK: ");
-    printf("k - King; q - Queen; r - Rook; ");
-    printf("n - kNight; b - Bishop; p - Pawn;\n\n");
-    printf("Desk:\n");
-    
-    Chess problem01;
-    loadChessProblemFromFile("chess_01.txt", &problem01, false);
-    //"chess_01.txt"
-    //"chess_02.txt"
-    //"chess_03.txt"
-    //"chess_04.txt"
-    //"chess_05.txt"
-    //"chess_06.txt"
-    problem01.printDesk(false, 0, 0);
-    
-    std::list< std::list<Chess::plyForOut> > solutions;
-    problem01.compute(&solutions);
-    //int a =Chess::DeskSizeX;
-    
-    printResolution(&solutions);
-    
-    
-    return 0;
+    char text[16];
+    snprintf(text, sizeof(text), "%c%c%d-%c%d", ply.pieceSymbol,
+             getXPositionSymbol(ply.xSourceField), ply.ySourceField,
+             getXPositionSymbol(ply.xDestinationField), ply.yDestinationField);
+    return text;
 }
-
-
-
@@ -0,0 +1,1244 @@
+#ifndef CHESS_H
+#define CHESS_H
+
+#include <iostream>
+#include <cstdio>
+#include <vector>
+#include <list>
+
+#include <string>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <thread>
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <algorithm>
+
+#include <cassert>
+
+
+/*
+1) Король    K (king)
+2) Ферзь     Q (queen)
+3) Ладья     R (rook)
+4) Конь      N (kNight)
+5) Слон      B (bishop)
+6) Пешка     P(pawn)
+
+
+Chess::Desk - вложенный класс, описывает текущую ситуацию на поле
+
+Формат входных данных в файле:
+целые числа, разделенные пробелом и переводом строки
+Первая строка вида:
+P W B
+где
+P - количество ходов из условия задачи
+W - количество белых фигур на доске
+B - количество черных фигур на доске
+далее N строк вида:
+A X Y
+где
+A - номер фигуры (тип)
+X - положение фигуры на доске по координате X (от левого края)
+Y - положение фигуры на доске по координате Y (от нижнего ряда)
+далее M строк вида:
+A X Y
+
+Поле 1 1 (A1) находится в нижнем левом углу доски
+Фигуры нумеруются от одного до семи в независимости от цвета
+1) Король    K (king)
+2) Ферзь     Q (queen)
+3) Ладья     R (rook)
+4) Конь      N (kNight)
+5) Слон      B (bishop)
+6) Пешка     P (pawn)
+7) Пешка, последний ход которой был двухшаговым
+   (Возможно взятие на проходе)
+*/
+
+//Счетчик выделений памяти в куче с начала работы программы - задается
+//программой (например, заменой глобального operator new, см. main.cpp).
+//По нему считается Chess::getSearchAllocationsAmount; без счетчика - 0
+typedef unsigned long long (*heapAllocationsCounter)();
+void setHeapAllocationsCounter(const heapAllocationsCounter counter);
+
+class Chess
+{
+    public:
+        
+        Chess();
+        
+        struct pieceForIn
+        {
+            int pieceType;
+            int xPosition;
+            int yPosition;
+        };
+
+        struct plyForOut
+        {
+            int plyNo;
+            int pieceType;
+            int pieceSymbol;
+            int xSourceField;
+            int ySourceField;
+            int xDestinationField;
+            int yDestinationField;
+            bool isCastling;
+            int whichPieceIfPromotion;
+        };
+
+        enum OperatingMode : int
+        {
+            Generator = 0,//Стандартный режим генерации ходов
+            FinalPly = 2, //Завершить генерацию сразу после генерации первого доступного полухода
+            CheckingPly = 3 //Генерировать только полуходы, объявляющие шах
+        };
+        
+        enum Settings : int
+        {
+            //задание параметров игрового поля в соответствии с шахматными правилами
+            
+            DeskSizeX = 8,
+            DeskSizeY = 8,
+            
+            XKingCPosition = 5,
+            XLeftRookCPosition = 1,
+            XRightRookCPosition = 8,
+            YWhiteKingCLine = 1,
+            YBlackKingCLine = 8,
+            
+            YWhiteStartPawnLine = 2, //Линяя, стоя на которой пешка может сделать двухшаговый ход
+            YWhitePromotionLine = 7, //Линяя, стоя на которую пешка может сделать ход и сразу превратиться
+            YBlackStartPawnLine = 7,
+            YBlackPromotionLine = 2,
+            
+            AmountTypesOfPieces = 6,
+            MaxPlys = 50,
+            MaxPlysInPosition = 256, //ёмкость списка полуходов из одной позиции (легальных не больше 218)
+            DefaultHashMegaBytes = 16, //размер таблицы транспозиций по умолчанию
+            DefaultThreadsAmount = 1, //число потоков решения по умолчанию
+            ParallelSplitPlys = 3, //наименьший запас полуходов узла, перебор которого делится между потоками
+            DefaultProofNodesLimit = 2000000, //предельное число узлов дерева поиска по числам доказательства
+            KillersAmount = 2, //опровержений черных, запоминаемых на каждую глубину
+            RefutationCandidates = 4, //защит черных, проверяемых до остальных ходов
+            ProofInfinity = 1000000000, //"бесконечное" число доказательства (опровержения)
+            NoSolutionNode = -1, //пустая ссылка в дереве решений
+            CastlingByPosition = -1, //права на рокировку определяются расстановкой короля и ладей
+            SolutionNodesReserve = 4096 //начальная емкость дерева решений
+        };
+        
+        enum PieceType : int
+        {
+            //Задание внутренних идентификаторов для разных видов фигур,
+            //для пустой клетки и для "бортика", обрамляющего поле.
+            
+            Empty = 0,
+            
+            WhiteKing = 1,
+            WhiteQueen = 2,
+            WhiteRook = 3,
+            WhiteKNight = 4,
+            WhiteBishop = 5,
+            WhitePawn = 6,
+            
+            BlackIdSum = 100,
+            
+            BlackKing = WhiteKing + BlackIdSum,
+            BlackQueen = WhiteQueen + BlackIdSum,
+            BlackRook = WhiteRook + BlackIdSum,
+            BlackKNight = WhiteKNight + BlackIdSum,
+            BlackBishop = WhiteBishop + BlackIdSum,
+            BlackPawn = WhitePawn + BlackIdSum,
+            
+            DeskBorder = 200
+        };
+
+        //Битборд - 64-битная маска полей доски,
+        //поле (x, y) соответствует биту номер (y - 1) * 8 + (x - 1)
+        typedef unsigned long long BitBoard;
+        
+        //Ключ позиции (хеш Зобриста)
+        typedef unsigned long long HashKey;
+
+        class BitBoards
+        {
+            //Номера и биты полей. Предрасчитанные таблицы атак короля, коня
+            //и пешек, "магические" таблицы атак ладьи и слона (или PEXT, если
+            //процессор поддерживает BMI2) и поиск по ним - в chess.cpp
+
+            public:
+
+                static bool initTables();
+
+                static inline int getSquare(const int xPosition, const int yPosition)
+                {return (yPosition - 1) * DeskSizeX + (xPosition - 1);}
+                static inline int getXPosition(const int square)
+                {return (square % DeskSizeX) + 1;}
+                static inline int getYPosition(const int square)
+                {return (square / DeskSizeX) + 1;}
+                static inline BitBoard getBit(const int square)
+                {return (1ULL << square);}
+
+                static inline int popFirstSquare(BitBoard *const bitBoard)
+                {
+                    assert(*bitBoard != 0);
+                    int square = __builtin_ctzll(*bitBoard);
+                    *bitBoard &= *bitBoard - 1;
+                    return square;
+                }
+
+                static BitBoard getKingAttacks(const int square);
+                static BitBoard getKNightAttacks(const int square);
+                
+                //Поля, на которые ходит король (конь), в порядке обхода направлений,
+                //незаполненные элементы равны -1
+                static const signed char *getKingSquares(const int square);
+                static const signed char *getKNightSquares(const int square);
+                
+                //Луч из поля в направлении q (нумерация как в generateQRB:
+                //0 - вверх, 1 - вправо, 2 - вниз, 3 - влево, 4 - вверх-вправо,
+                //5 - вниз-вправо, 6 - вниз-влево, 7 - вверх-влево)
+                static BitBoard getRay(const int square, const int q);
+                //Вдоль лучей 2, 3, 5, 6 номера полей убывают
+                static inline bool getIsRayReversed(const int q)
+                {return (q == 2 || q == 3 || q == 5 || q == 6);}
+                
+                //Поля строго между двумя полями одной линии
+                //(пусто, если поля не на одной вертикали, горизонтали или диагонали)
+                static BitBoard getBetween(const int square1, const int square2);
+                static BitBoard getPawnAttacks(const bool isWhite, const int square);
+
+                static BitBoard getRookAttacks(const int square, const BitBoard occupied);
+                static BitBoard getBishopAttacks(const int square, const BitBoard occupied);
+                static BitBoard getQueenAttacks(const int square, const BitBoard occupied);
+        };
+        
+        class Zobrist
+        {
+            //Случайные ключи Зобриста: ключ позиции - xor ключей фигур на полях,
+            //ключа очередности хода (ход черных), ключа прав на рокировку
+            //и ключа вертикали, на которой возможно взятие на проходе
+            
+            public:
+                
+                static bool initKeys();
+                
+                //side: [0] - белые, [1] - черные; pieceType - тип без учета цвета
+                static inline HashKey getPieceKey(const int side, const int pieceType,
+                                                  const int square)
+                {return pieceKeys[side][pieceType][square];}
+                static inline HashKey getBlackTurnKey(){return blackTurnKey;}
+                //castlingPermits - биты 1, 2 - белые O-O, O-O-O; 4, 8 - черные
+                static inline HashKey getCastlingKey(const unsigned int castlingPermits)
+                {return castlingKeys[castlingPermits];}
+                static inline HashKey getEnPassantKey(const int xPosition)
+                {return enPassantKeys[xPosition - 1];}
+                
+            private:
+                
+                static HashKey pieceKeys[2][AmountTypesOfPieces + 1][DeskSizeX * DeskSizeY];
+                static HashKey blackTurnKey;
+                static HashKey castlingKeys[16];
+                static HashKey enPassantKeys[DeskSizeX];
+                
+                static HashKey getNextRandom(HashKey *const state);
+        };
+
+        class PackedPly
+        {
+            //Полуход, упакованный в 32 бита:
+            //биты 0-5 - исходное поле, 6-11 - поле назначения,
+            //12-15 - ходящая фигура, 16-19 - взятая фигура,
+            //20-23 - фигура, в которую превращается пешка,
+            //24 - рокировка, 25 - взятие на проходе.
+            //Фигура хранится как тип (1-6) плюс бит цвета (8 - черные).
+            //Состояние для возврата хода сюда не входит (см. Desk::plyUndo).
+            
+            public:
+                PackedPly(){code = 0;}
+                explicit PackedPly(const unsigned int packedCode){code = packedCode;}
+                PackedPly(const int sourceSquare,
+                          const int destinationSquare,
+                          const int movingPieceType,
+                          const int whichPieceIfTaking,
+                          const bool isCastling,
+                          const int whichPieceIfPromotion,
+                          const bool isEnPassant)
+                {
+                    assert(sourceSquare >= 0 && sourceSquare < DeskSizeX * DeskSizeY);
+                    assert(destinationSquare >= 0 && destinationSquare < DeskSizeX * DeskSizeY);
+                    code = (unsigned int)sourceSquare |
+                           ((unsigned int)destinationSquare << 6) |
+                           (encodePiece(movingPieceType) << 12) |
+                           (encodePiece(whichPieceIfTaking) << 16) |
+                           (encodePiece(whichPieceIfPromotion) << 20) |
+                           (isCastling ? (1U << 24) : 0) |
+                           (isEnPassant ? (1U << 25) : 0);
+                }
+                
+                inline int getSourceSquare() const {return code & 63;}
+                inline int getDestinationSquare() const {return (code >> 6) & 63;}
+                inline int getXSourceField() const
+                {return BitBoards::getXPosition(getSourceSquare());}
+                inline int getYSourceField() const
+                {return BitBoards::getYPosition(getSourceSquare());}
+                inline int getXDestinationField() const
+                {return BitBoards::getXPosition(getDestinationSquare());}
+                inline int getYDestinationField() const
+                {return BitBoards::getYPosition(getDestinationSquare());}
+                
+                inline int getMovingPieceType() const {return decodePiece(code >> 12);}
+                inline int getWhichPieceIfTaking() const {return decodePiece(code >> 16);}
+                inline int getWhichPieceIfPromotion() const {return decodePiece(code >> 20);}
+                inline bool getIsCastling() const {return (code >> 24) & 1;}
+                inline bool getIsEnPassant() const {return (code >> 25) & 1;}
+                inline unsigned int getCode() const {return code;}
+                
+                inline bool operator == (const PackedPly &p) const {return code == p.code;}
+                inline bool operator != (const PackedPly &p) const {return code != p.code;}
+                
+            private:
+                unsigned int code;
+                
+                static inline unsigned int encodePiece(const int pieceID)
+                {
+                    assert(pieceID >= Empty && pieceID != DeskBorder);
+                    if(pieceID > BlackIdSum){return (unsigned int)(pieceID - BlackIdSum) | 8;}
+                    return (unsigned int)pieceID;
+                }
+                static inline int decodePiece(const unsigned int pieceCode)
+                {
+                    if((pieceCode & 7) == 0){return Empty;}
+                    if(pieceCode & 8){return (int)(pieceCode & 7) + BlackIdSum;}
+                    return (int)(pieceCode & 7);
+                }
+        };
+        
+        class PlyList
+        {
+            //Список полуходов фиксированной ёмкости с интерфейсом очереди.
+            //Размещается на стеке, в отличие от std::queue не обращается к куче.
+            public:
+                PlyList(){amount = 0; first = 0;}
+                
+                inline void push(const PackedPly newMove)
+                {
+                    assert(amount < MaxPlysInPosition);
+                    plys[amount] = newMove;
+                    amount++;
+                }
+                inline PackedPly front()
+                {
+                    assert(first < amount);
+                    return plys[first];
+                }
+                inline void pop()
+                {
+                    assert(first < amount);
+                    first++;
+                }
+                inline bool empty(){return (first == amount);}
+                inline int size(){return (amount - first);}
+                inline void clear(){amount = 0; first = 0;}
+                
+                //i-й полуход от начала очереди
+                inline PackedPly at(const int i)
+                {
+                    assert(i >= 0 && first + i < amount);
+                    return plys[first + i];
+                }
+                
+                inline bool getIsContaining(const PackedPly move)
+                {
+                    for(int i = first; i < amount; i++)
+                    {
+                        if(plys[i] == move){return true;}
+                    }
+                    return false;
+                }
+                //Перенос полухода в начало очереди, порядок остальных сохраняется
+                inline void moveToFront(const PackedPly move)
+                {
+                    for(int i = first; i < amount; i++)
+                    {
+                        if(plys[i] == move)
+                        {
+                            for(int j = i; j > first; j--){plys[j] = plys[j - 1];}
+                            plys[first] = move;
+                            return;
+                        }
+                    }
+                }
+                
+            private:
+                PackedPly plys[MaxPlysInPosition];
+                int amount;
+                int first;
+        };
+        
+        class TranspositionTable
+        {
+            //Таблица уже доказанных и опровергнутых позиций.
+            //Мат, доказанный за depth полуходов, доказан и при большем запасе
+            //полуходов; опровержение на depth полуходах верно и при меньшем.
+            //Корзина из двух записей: первая замещается только записью
+            //не меньшей глубины, вторая - всегда.
+            //Таблица может быть общей для нескольких потоков (share) и обходится
+            //без блокировок: запись хранится двумя 64-битными словами - данными
+            //и ключом, сложенным с данными по xor. Запись, разорванная
+            //одновременной записью другого потока, не проходит проверку ключа.
+            //Записи помечены поколением (новое - на каждую задачу): записи
+            //прежних поколений считаются пустыми, так что поиск идет так же,
+            //как с только что очищенной таблицей, но без ее очистки.
+            
+            public:
+                
+                enum Bound : unsigned char
+                {
+                    NoBound = 0,
+                    Proven = 1, //мат за depth полуходов доказан
+                    Refuted = 2 //мата за depth полуходов нет
+                };
+                
+                struct entry
+                {
+                    HashKey key;
+                    PackedPly bestMove; //первый доказывающий ход белых или опровержение черных
+                    signed char depth;
+                    unsigned char bound;
+                };
+                
+                TranspositionTable(){bucketsMask = 0; generation = 0;}
+                
+                void setSize(const int megaBytes)
+                {
+                    //количество корзин округляется вниз до степени двойки
+                    assert(megaBytes >= 1);
+                    size_t bucketsAmount = 1;
+                    while(bucketsAmount * 2 * sizeof(bucket) <= (size_t)megaBytes << 20)
+                        {bucketsAmount *= 2;}
+                    buckets.reset(new bucket[bucketsAmount], std::default_delete<bucket[]>());
+                    bucketsMask = bucketsAmount - 1;
+                    clear();
+                }
+                inline bool getIsAllocated(){return buckets != NULL;}
+                void clear()
+                {
+                    for(size_t i = 0; i <= bucketsMask && getIsAllocated(); i++)
+                    {
+                        for(int j = 0; j < 2; j++)
+                        {
+                            buckets.get()[i].checks[j].store(0, std::memory_order_relaxed);
+                            buckets.get()[i].data[j].store(0, std::memory_order_relaxed);
+                        }
+                    }
+                    generation = 0;
+                }
+                //Новое поколение - все записи становятся недействительными.
+                //Таблица очищается, только когда счетчик поколений исчерпан
+                void startGeneration()
+                {
+                    generation = (generation + GenerationStep) & GenerationMask;
+                    if(generation == 0){clear();}
+                }
+                //использовать записи таблицы table (таблица становится общей)
+                void share(const TranspositionTable &table)
+                {
+                    buckets = table.buckets;
+                    bucketsMask = table.bucketsMask;
+                    generation = table.generation;
+                }
+                
+                inline bool probe(const HashKey key, entry *const result)
+                {
+                    bucket &b = buckets.get()[key & bucketsMask];
+                    for(int j = 0; j < 2; j++)
+                    {
+                        unsigned long long data = b.data[j].load(std::memory_order_relaxed);
+                        unsigned long long check = b.checks[j].load(std::memory_order_relaxed);
+                        if((check ^ data) == key && getBound(data) != NoBound &&
+                           (data & GenerationMask) == generation)
+                        {
+                            result->key = key;
+                            result->bestMove = PackedPly((unsigned int)data);
+                            result->depth = (signed char)(data >> 32);
+                            result->bound = getBound(data);
+                            return true;
+                        }
+                    }
+                    return false;
+                }
+                
+                inline void store(const HashKey key, const int depth,
+                                  const Bound bound, const PackedPly bestMove)
+                {
+                    bucket &b = buckets.get()[key & bucketsMask];
+                    unsigned long long firstData = b.data[0].load(std::memory_order_relaxed);
+                    unsigned long long firstCheck = b.checks[0].load(std::memory_order_relaxed);
+                    int slot = 1;
+                    if((firstData & GenerationMask) != generation ||
+                       (firstCheck ^ firstData) == key || getBound(firstData) == NoBound ||
+                       depth >= (signed char)(firstData >> 32))
+                        {slot = 0;}
+                    
+                    unsigned long long data = (unsigned long long)bestMove.getCode() |
+                                              ((unsigned long long)(unsigned char)depth << 32) |
+                                              ((unsigned long long)bound << 40) | generation;
+                    b.data[slot].store(data, std::memory_order_relaxed);
+                    b.checks[slot].store(key ^ data, std::memory_order_relaxed);
+                }
+                
+            private:
+                
+                struct bucket
+                {
+                    std::atomic<unsigned long long> checks[2]; //ключ xor данные
+                    std::atomic<unsigned long long> data[2];
+                };
+                
+                static inline Bound getBound(const unsigned long long data)
+                {return (Bound)((data >> 40) & 0xFF);}
+                
+                //данные записи: биты 0-31 - полуход, 32-39 - глубина,
+                //40-47 - граница, 48-63 - поколение
+                static const unsigned long long GenerationStep = 1ULL << 48;
+                static const unsigned long long GenerationMask = 0xFFFFULL << 48;
+                
+                std::shared_ptr<bucket> buckets;
+                size_t bucketsMask;
+                unsigned long long generation; //поколение, уже сдвинутое в биты 48-63
+        };
+        
+        char getPieceSymbol(const int pieceID);
+        
+        void printDesk(const bool isPreviousPositionShow,
+                       const int xPreviousPosition,
+                       const int yPreviousPosition);
+
+        //Загрузка задачи; прежняя задача заменяется (см. reset).
+        //castlingPermits - биты 1, 2 - белые O-O, O-O-O; 4, 8 - черные
+        //(права, противоречащие расстановке, сбрасываются) или CastlingByPosition
+        void loadChessProblem(const bool isWhiteFirst,
+                              const bool isEnPassant,
+                              const int xPawnPosIfEnPassant,
+                              const int yPawnPosIfEnPassant,
+                              const int castlingPermits,
+                              const int nMoves,
+                              std::list<pieceForIn> * const pieces);
+        
+        //то же для расстановки в массиве (без промежуточного списка)
+        void loadChessProblem(const bool isWhiteFirst,
+                              const bool isEnPassant,
+                              const int xPawnPosIfEnPassant,
+                              const int yPawnPosIfEnPassant,
+                              const int castlingPermits,
+                              const int nMoves,
+                              const pieceForIn * const pieces,
+                              const int piecesAmount);
+        
+        //Получатель решений: visitPath вызывается для каждого пути решения.
+        //compute, computeShortest и computeProofNumber сначала доказывают мат,
+        //сохраняя дерево решения в таблице узлов, затем обходят готовое дерево
+        //и выдают пути по одному - список всех путей не строится. computeKeys
+        //выдает каждый ключ (путь из одного полухода) сразу после его
+        //доказательства. path (полуходы от первого хода белых) действителен
+        //только на время вызова
+        class solutionVisitor
+        {
+            public:
+                virtual ~solutionVisitor(){}
+                virtual void visitPath(const plyForOut * const path, const int pathLength) = 0;
+        };
+        
+        //visitor может быть NULL - тогда пути не выдаются,
+        //печатается только их количество.
+        //Возвращает число путей решения (0, если мата нет)
+        int compute(solutionVisitor * const visitor);
+        //Поиск кратчайшего мата: мат в 1, 2, ... до числа ходов из условия.
+        //Возвращает найденное число ходов (0, если мата нет)
+        int computeShortest(solutionVisitor * const visitor);
+        //Поиск только ключа - первого хода белых - без сбора путей решения.
+        //Останавливается на первом доказанном ключе; при isCooksCounting
+        //проверяются все первые ходы и выдаются все ключи (побочные решения).
+        //Каждый ключ - путь из одного полухода, выдается сразу после
+        //доказательства. Возвращает число ключей
+        int computeKeys(solutionVisitor * const visitor, const bool isCooksCounting);
+        
+        //Поиск по числам доказательства (proof-number search) - альтернатива compute():
+        //дерево строится в таблице узлов ограниченного размера, раскрывается
+        //наиболее доказывающий узел. Возвращает 1 - мат доказан, 0 - мата нет,
+        //-1 - исчерпан предел числа узлов
+        int computeProofNumber(solutionVisitor * const visitor);
+        
+        //то же со сбором всех путей в список
+        int compute(std::list< std::list<plyForOut> > * const solutionsForOut);
+        int computeShortest(std::list< std::list<plyForOut> > * const solutionsForOut);
+        int computeKeys(std::list< std::list<plyForOut> > * const solutionsForOut,
+                        const bool isCooksCounting);
+        int computeProofNumber(std::list< std::list<plyForOut> > * const solutionsForOut);
+        
+        //Сброс к пустой доске перед новой задачей. Рабочие буферы (история
+        //ходов доски, дерево решений, узлы поиска по числам доказательства)
+        //сохраняют емкость, так что один экземпляр решает задачу за задачей
+        //без обращений к куче. Таблица транспозиций не очищается, а начинает
+        //новое поколение: записи прежних задач не используются, поэтому
+        //решение и число узлов не зависят от ранее решенных задач
+        void reset();
+        
+        //размер таблицы транспозиций в мегабайтах (по умолчанию DefaultHashMegaBytes);
+        //таблица перевыделяется только при изменении размера
+        void setHashSize(const int megaBytes)
+        {
+            if(megaBytes == hashMegaBytes && transpositions.getIsAllocated()){return;}
+            hashMegaBytes = megaBytes;
+            transpositions.setSize(megaBytes);
+        }
+        //число потоков для compute() и computeShortest() (по умолчанию DefaultThreadsAmount)
+        void setThreadsAmount(const int amount){assert(amount >= 1); threadsAmount = amount;}
+        //предельное число узлов для computeProofNumber (по умолчанию DefaultProofNodesLimit)
+        void setProofNodesLimit(const int nodesAmount)
+        {assert(nodesAmount > 1); proofNodesLimit = nodesAmount;}
+        //число выделений памяти в куче за время последнего поиска
+        //(без развертывания решений в список путей)
+        unsigned long long getSearchAllocationsAmount(){return searchAllocationsAmount;}
+        //число узлов, перебранных последним поиском (во всех потоках)
+        unsigned long long getNodesAmount(){return nodesAmount;}
+        //печать итогов поиска (число путей и т.п.), по умолчанию включена
+        void setIsPrinting(const bool isOn){isPrinting = isOn;}
+        //число ходов из условия задачи
+        int getMovesAmount(){return (totalPlys + 1) / 2;}
+        //Задача загружена с переставленными цветами (задача с ходом черных,
+        //решается отраженной, первыми ходят белые): полуходы решения и доска
+        //выдаются в обозначениях исходной задачи. Сбрасывается при загрузке
+        void setIsColorsSwapped(const bool isSwapped){isColorsSwapped = isSwapped;}
+        
+        //perft - число листьев дерева легальных полуходов глубины depth,
+        //perftDivide дополнительно печатает число листьев для каждого
+        //первого полухода, время счёта и скорость (узлов в секунду)
+        unsigned long long perft(const int depth);
+        unsigned long long perftDivide(const int depth);
+        
+        //Отладка генератора: полуходы, сгенерированные в загруженной позиции,
+        //сверяются с файлом expectedPlys (формат chess_test_*_out.txt)
+        bool testGenerator(FILE * const expectedPlys);
+        
+    private:
+        
+        //отладочные функции и данные
+        void printTesting();
+        bool test();
+        void computeTest();
+        void loadTestOut(FILE *f);
+        std::list<PackedPly> testing;
+        std::list<PackedPly> testingOut;
+        
+        bool computeResolutionRecursion(const int nPlysRest, int *const solutionsTree);
+        
+        //обход дерева решений (цепочки firstSolution): каждый путь до листа
+        //выдается visitor; path - буфер на MaxPlys полуходов
+        void visitSolutions(const int firstSolution, plyForOut *const path,
+                            const int pathLength, solutionVisitor * const visitor);
+        plyForOut getPlyForOut(const PackedPly ply, const int plyNo);
+        int getSolutionPathsAmount(const int firstSolution);
+        
+        class Desk
+        {
+            private:
+                
+                int desk[DeskSizeX + 2][DeskSizeY + 2];
+                
+                //Битборды, дублирующие desk: по каждому типу фигур
+                //для каждого цвета ([0] - белые, [1] - черные), по цвету и все фигуры
+                BitBoard pieces[2][AmountTypesOfPieces + 1];
+                BitBoard sidePieces[2];
+                BitBoard occupied;
+                
+                HashKey hashKey; //обновляется при каждом изменении позиции
+                
+                bool isWhiteTurn;
+                
+                bool isWhiteShortCPermit, isWhiteLongCPermit;
+                bool isBlackShortCPermit, isBlackLongCPermit;
+                
+                bool isEnPassantPossible;
+                int xPosMovedPawn, yPosMovedPawn;
+                
+                inline void moveRookForCastling(const int xKingDestinationField,
+                                                const int yKingDestinationField);
+                
+                void initDesk();
+                void setField(const int xPosition, const int yPosition,
+                              const int PieceType)
+                {
+                    assert(xPosition >= 1 && yPosition >= 1);
+                    assert(xPosition <= DeskSizeX && yPosition <= DeskSizeY);
+                    
+                    BitBoard bit = BitBoards::getBit(BitBoards::getSquare(xPosition, yPosition));
+                    int oldPieceType = desk[xPosition][yPosition];
+                    if(oldPieceType != Empty)
+                    {
+                        pieces[getSide(oldPieceType)][getBaseType(oldPieceType)] &= ~bit;
+                        sidePieces[getSide(oldPieceType)] &= ~bit;
+                        occupied &= ~bit;
+                        hashKey ^= Zobrist::getPieceKey(getSide(oldPieceType),
+                                                        getBaseType(oldPieceType),
+                                                        BitBoards::getSquare(xPosition, yPosition));
+                    }
+                    if(PieceType != Empty)
+                    {
+                        pieces[getSide(PieceType)][getBaseType(PieceType)] |= bit;
+                        sidePieces[getSide(PieceType)] |= bit;
+                        occupied |= bit;
+                        hashKey ^= Zobrist::getPieceKey(getSide(PieceType),
+                                                        getBaseType(PieceType),
+                                                        BitBoards::getSquare(xPosition, yPosition));
+                    }
+                    desk[xPosition][yPosition] = PieceType;
+                }
+                
+                struct plyUndo
+                {
+                    //Запись истории для возврата хода
+                    PackedPly move;
+                    unsigned char castlingPermitsPrevious; //биты: 1, 2 - белые O-O, O-O-O; 4, 8 - черные
+                    bool isEnPassantPossiblePrevious;
+                    signed char xPosMovedPawnPrevious, yPosMovedPawnPrevious;
+                    HashKey hashKeyPrevious;
+                };
+                
+                inline unsigned int getCastlingPermits()
+                {
+                    return (isWhiteShortCPermit ? 1 : 0) |
+                           (isWhiteLongCPermit ? 2 : 0) |
+                           (isBlackShortCPermit ? 4 : 0) |
+                           (isBlackLongCPermit ? 8 : 0);
+                }
+                //часть ключа, зависящая от прав на рокировку и взятия на проходе
+                inline HashKey getStateHashKey()
+                {
+                    HashKey stateKey = Zobrist::getCastlingKey(getCastlingPermits());
+                    if(isEnPassantPossible){stateKey ^= Zobrist::getEnPassantKey(xPosMovedPawn);}
+                    return stateKey;
+                }
+                HashKey computeHashKey();
+                
+                std::vector<plyUndo> previousPlys;
+                
+            public:
+                Desk();
+                //пустая доска; емкость истории ходов сохраняется
+                void clearDesk();
+                
+                void switchTurn()
+                {
+                    isWhiteTurn = !isWhiteTurn;
+                    hashKey ^= Zobrist::getBlackTurnKey();
+                }
+                
+                inline bool getIsWhiteTurn(){return isWhiteTurn;}
+                inline HashKey getHashKey(){return hashKey;}
+                
+                inline int getField(const int xPosition, const int yPosition)
+                {
+                    assert(xPosition >= 0 && yPosition >= 0);
+                    assert(xPosition <= DeskSizeX + 1 &&
+                           yPosition <= DeskSizeY + 1 );
+                    
+                    return desk[xPosition][yPosition];
+                }
+                
+                //bool setIsWhiteTurn(bool is){isWhiteTurn = is;}
+                
+                //Цвет ([0] - белые, [1] - черные) и тип фигуры без учёта цвета
+                static inline int getSide(const int pieceID)
+                {return (pieceID > BlackIdSum) ? 1 : 0;}
+                static inline int getBaseType(const int pieceID)
+                {return (pieceID > BlackIdSum) ? (pieceID - BlackIdSum) : pieceID;}
+                
+                inline BitBoard getPieces(const bool isWhite, const int pieceType)
+                {
+                    assert(pieceType >= WhiteKing && pieceType <= AmountTypesOfPieces);
+                    return pieces[isWhite ? 0 : 1][pieceType];
+                }
+                inline BitBoard getSidePieces(const bool isWhite)
+                {return sidePieces[isWhite ? 0 : 1];}
+                inline BitBoard getOccupied(){return occupied;}
+                
+                inline bool getIsEnPassantPossible()
+                {return isEnPassantPossible;}
+                inline int getXPosMovedPawn(){return xPosMovedPawn;}
+                inline int getYPosMovedPawn(){return yPosMovedPawn;}
+                
+                //Положение короля берется из его битборда,
+                //отдельно координаты королей не хранятся
+                inline int getKingSquare(const bool isWhite)
+                {
+                    assert(pieces[isWhite ? 0 : 1][WhiteKing] != 0);
+                    return __builtin_ctzll(pieces[isWhite ? 0 : 1][WhiteKing]);
+                }
+                inline int getXWhiteKingPosition()
+                {return BitBoards::getXPosition(getKingSquare(true));}
+                inline int getYWhiteKingPosition()
+                {return BitBoards::getYPosition(getKingSquare(true));}
+                inline int getXBlackKingPosition()
+                {return BitBoards::getXPosition(getKingSquare(false));}
+                inline int getYBlackKingPosition()
+                {return BitBoards::getYPosition(getKingSquare(false));}
+                
+                inline bool getIsWhiteShortCPermit()
+                {return (isWhiteShortCPermit);}
+                inline bool getIsWhiteLongCPermit()
+                {return (isWhiteLongCPermit);}
+                inline bool getIsBlackShortCPermit()
+                {return (isBlackShortCPermit);}
+                inline bool getIsBlackLongCPermit()
+                {return (isBlackLongCPermit);}
+                
+                void makeMoveAhead(const PackedPly newMove,
+                                   const bool isTurnChanging);
+                void makeMoveBack(const bool isTurnChanging);
+                
+                void setDesk(const bool isWhiteFirst,
+                             const bool isEnPassant,
+                             const int xPawnPosIfEnPassant,
+                             const int yPawnPosIfEnPassant,
+                             const int castlingPermits,
+                             const int totalPlys,
+                             const pieceForIn * const pieces,
+                             const int piecesAmount);
+            
+                bool operator == (const Desk &d1);//для отладки
+        };
+        
+        Desk desk;
+        //void printPiece(int pieceID);
+        
+        TranspositionTable transpositions;
+        //при поиске кратчайшего мата ход, доказанный на меньшей глубине,
+        //перебирается первым
+        bool isShortestMateSearch;
+        int hashMegaBytes;
+        
+        //Дерево решений одного поиска. Узел - полуход, его дети - продолжения;
+        //каждый путь от корня до листа - вариант решения. Узлы выделяются
+        //подряд в solutionNodes; узлы опровергнутой ветви освобождаются
+        //откатом размера таблицы к размеру на входе в узел поиска.
+        struct solutionNode
+        {
+            PackedPly move;
+            int firstChild;
+            int nextSibling;
+        };
+        std::vector<solutionNode> solutionNodes;
+        unsigned long long searchAllocationsAmount;
+        unsigned long long nodesAmount;
+        bool isPrinting;
+        
+        //добавление узла в конец цепочки first..last
+        void addSolutionNode(const PackedPly move, const int firstChild,
+                             int *const first, int *const last);
+        
+        //Параллельный поиск с разделением работы: у каждого потока своя копия
+        //задачи (доска, killers), таблица транспозиций общая.
+        //Поток, перебравший первый полуход узла (с запасом не меньше
+        //ParallelSplitPlys) при наличии свободных потоков, открывает узел
+        //разделения - остальные полуходы узла разбирают свободные потоки.
+        //Найденные доказывающий ход белых или опровержение черных отменяют
+        //перебор соседей (для белых - только стоящих в порядке перебора
+        //после него, поэтому доказывающий ход тот же, что и последовательно).
+        //Пути решения затем собираются последовательным проходом по таблице.
+        int threadsAmount;
+        
+        struct splitFrame;
+        struct splitPoint
+        {
+            Desk desk; //позиция узла
+            PlyList plys; //оставшиеся полуходы узла в порядке перебора
+            int nPlysRest;
+            bool isWhiteNode;
+            const splitFrame *parentFrame; //положение узла в дереве (для отмены)
+            std::atomic<int> nextPly; //номер следующего не взятого полухода
+            std::atomic<int> firstProvingPly; //белые: наименьший номер доказывающего полухода
+            std::atomic<bool> isRefuted; //черные: найдено опровержение
+            std::atomic<unsigned int> refutation;
+            std::atomic<int> workersAmount; //потоки, перебирающие полуходы узла
+        };
+        struct splitFrame
+        {
+            //поиск идет под полуходом plyIndex узла разделения split
+            splitPoint *split;
+            int plyIndex;
+            const splitFrame *parent;
+        };
+        struct splitPool
+        {
+            std::mutex mutex; //защищает только список splits
+            std::vector<splitPoint*> splits; //узлы с не взятыми полуходами
+            std::atomic<int> idleAmount; //потоки без работы
+            std::atomic<bool> isFinished;
+        };
+        splitPool *pool; //NULL вне параллельного поиска
+        //Узлы разделения, открытые потоком. Узлы одного потока вложены
+        //друг в друга, поэтому запас полуходов (индекс) у них разный.
+        splitPoint splitPoints[MaxPlys];
+        
+        bool computeResolutionParallel(const int nPlysRest, int *const solutionsTree);
+        //мат за nPlysRest полуходов из текущей позиции (без сбора путей),
+        //при threadsAmount > 1 - параллельным поиском
+        bool computeIsMate(const int nPlysRest);
+        //Запуск вспомогательных потоков (workers - threadsAmount - 1 экземпляров,
+        //получают копию задачи и общую таблицу транспозиций) и их остановка
+        //с подсчетом узлов. Пока потоки
+        //запущены, searchParallel из этого экземпляра делит перебор с ними
+        void startHelpers(splitPool *const sharedPool, std::vector<Chess> *const workers,
+                          std::vector<std::thread> *const threads);
+        void stopHelpers(splitPool *const sharedPool, std::vector<Chess> *const workers,
+                         std::vector<std::thread> *const threads);
+        bool searchParallel(const int nPlysRest, const splitFrame *const frame);
+        bool searchSplit(const int nPlysRest, const splitFrame *const frame,
+                         PlyList *plys, PackedPly *resolvingPly);
+        void workOnSplit(splitPoint *const split);
+        bool helpSplits(const splitPoint *const ownSplit);
+        void workParallel();
+        static bool getIsAborted(const splitFrame *frame);
+        
+        //Защиты черных, уже опровергавшие попытки белых: по две последних
+        //на каждый запас полуходов (killers) и счетчики по полям хода (history).
+        //В узле черных они проверяются первыми - опровержение соседней
+        //попытки белых чаще всего опровергает и текущую.
+        PackedPly killers[MaxPlys][KillersAmount];
+        unsigned int refutationHistory[DeskSizeX * DeskSizeY][DeskSizeX * DeskSizeY];
+        
+        void clearRefutations();
+        void noteRefutation(const int nPlysRest, const PackedPly refutation);
+        PackedPly getBestHistoryPly(PlyList *plys);
+        
+        struct proofNode
+        {
+            //Узел дерева поиска по числам доказательства.
+            //Позиция узла не хранится - она получается ходами от корня.
+            PackedPly move; //полуход, ведущий в узел
+            int parent;
+            int firstChild; //дети узла лежат в таблице подряд
+            unsigned short childrenAmount;
+            signed char nPlysRest;
+            bool isExpanded;
+            int proof; //сколько узлов нужно доказать, чтобы доказать мат
+            int disproof; //сколько узлов нужно опровергнуть, чтобы опровергнуть мат
+        };
+        
+        std::vector<proofNode> proofNodes;
+        int proofNodesLimit;
+        
+        void evaluateProofNode(proofNode *const node);
+        bool expandProofNode(const int nodeIndex);
+        void updateProofNumbers(proofNode *const node);
+        int collectProofPaths(const int nodeIndex);
+        
+        int totalPlys;
+        //задача с ходом черных загружена отраженной (см. setIsColorsSwapped)
+        bool isColorsSwapped;
+        static int getSwappedPieceType(const int pieceType)
+        {
+            if(pieceType > BlackIdSum && pieceType <= BlackIdSum + AmountTypesOfPieces)
+                {return pieceType - BlackIdSum;}
+            if(pieceType >= 1 && pieceType <= AmountTypesOfPieces){return pieceType + BlackIdSum;}
+            return pieceType;
+        }
+        
+        struct legalityMasks
+        {
+            //Рассчитываются один раз на позицию перед генерацией ходов
+            int kingSquare;
+            BitBoard checkers; //фигуры, объявившие шах
+            BitBoard checkMask; //поля, ходом на которые (не королем) снимается шах
+            BitBoard pinned; //связанные фигуры стороны, делающей ход
+            BitBoard pinLines[DeskSizeX * DeskSizeY]; //линия связки для связанной фигуры
+            BitBoard kingDanger; //поля, битые противником (король снят с доски)
+            bool isKingDangerReady;
+        };
+        
+        legalityMasks legality;
+        
+        struct checkingMasks
+        {
+            //Рассчитываются для генерации шахующих полуходов и сортировки ходов
+            int enemyKingSquare;
+            BitBoard checkFields[AmountTypesOfPieces + 1]; //поля, с которых фигура данного типа шахует
+            BitBoard discoverers; //свои фигуры, уход которых открывает шах дальнобойной фигурой
+        };
+        
+        checkingMasks checking;
+        
+        void initCheckingMasks();
+        bool getIsCheckingPly(const PackedPly newMove);
+        void orderPlys(PlyList *plys);
+        //поля, ходом на которые фигура с поля square может объявить шах
+        //(для фигуры, открывающей шах, - любые поля)
+        template<OperatingMode mode>
+        inline BitBoard getCheckingFields(const int square, const int pieceType)
+        {
+            if(mode != CheckingPly){return ~0ULL;}
+            if(checking.discoverers & BitBoards::getBit(square)){return ~0ULL;}
+            return checking.checkFields[pieceType];
+        }
+        
+        void initLegalityMasks();
+        BitBoard getKingDanger();
+        inline BitBoard getAllowedFields(const int square)
+        {
+            //поля, на которые фигура с поля square может пойти,
+            //не оставив своего короля под шахом
+            BitBoard allowedFields = legality.checkMask;
+            if(legality.pinned & BitBoards::getBit(square))
+                {allowedFields &= legality.pinLines[square];}
+            return allowedFields;
+        }
+        
+        PackedPly makePly(const int xSourceField,
+                          const int ySourceField,
+                          const int xDestinationField,
+                          const int yDestinationField,
+                          const int whichPieceIfTaking,
+                          const int isCastling,
+                          const int whichPieceIfPromotion,
+                          const bool isEnPassant);
+        bool getIsPlyLegal(const PackedPly newMove);
+        
+        void addMove(PlyList *plys,
+                     const OperatingMode mode,
+                     const PackedPly newMove);        
+        void addMove(PlyList *plys,
+                     const OperatingMode mode,
+                     const int xSourceField,
+                     const int ySourceField,
+                     const int xDestinationField,
+                     const int yDestinationField,
+                     const int whichPieceIfTaking,
+                     const int isCastling,
+                     const int whichPieceIfPromotion);
+        
+        bool getIsFieldUnderAttack(const int xPosition, const int yPosition);
+        bool getIsFieldUnderAttack(const int square, const bool isByWhite,
+                                   const BitBoard occupied);
+        
+        //Генераторы специализированы по цвету стороны, делающей ход (isWhite),
+        //и режиму генерации (mode), так что проверки цвета и режима
+        //выполняются при компиляции. Выбор специализации делается
+        //один раз на позицию в generateAllPlys(plys, mode).
+        void generateAllPlys(PlyList *plys,
+                             const OperatingMode mode);
+        template<bool isWhite, OperatingMode mode>
+        void generateAllPlys(PlyList *plys);
+        template<bool isWhite, OperatingMode mode>
+        bool generateKing(PlyList *plys, const int xPosition, const int yPosition);
+        template<bool isWhite, OperatingMode mode>
+        bool generateQueen(PlyList *plys, const int xPosition, const int yPosition);
+        template<bool isWhite, OperatingMode mode>
+        bool generateRook(PlyList *plys, const int xPosition, const int yPosition);
+        template<bool isWhite, OperatingMode mode>
+        bool generateKNight(PlyList *plys, const int xPosition, const int yPosition);
+        template<bool isWhite, OperatingMode mode>
+        bool generateBishop(PlyList *plys, const int xPosition, const int yPosition);
+        template<bool isWhite, OperatingMode mode>
+        bool generatePawn(PlyList *plys, const int xPosition, const int yPosition);
+        template<bool isWhite, OperatingMode mode>
+        bool generateQRB(PlyList *plys, const bool isMovingLikeRook,
+                         const bool isMovingLikeBishop, const int xPosition,
+                         const int yPosition);
+        template<OperatingMode mode>
+        bool addMovesToTargets(PlyList *plys,
+                               const int xSourceField, const int ySourceField,
+                               BitBoard targets, const bool isReversed);
+        template<OperatingMode mode>
+        bool addMovesToSquares(PlyList *plys,
+                               const int xSourceField, const int ySourceField,
+                               const signed char *const squares,
+                               const BitBoard allowedFields);
+        
+        template<bool isWhite>
+        inline bool getIsEnemy(const int xPosition, const int yPosition);
+        inline bool getIsEmpty(const int xPosition, const int yPosition);
+        //bool getIsPiece(int xPosition, int yPosition);
+        
+        inline bool getIsKing(const int xPosition, const int yPosition);
+        inline bool getIsQueen(const int xPosition, const int yPosition);
+        inline bool getIsRook(const int xPosition, const int yPosition);
+        inline bool getIsKNight(const int xPosition, const int yPosition);
+        inline bool getIsBishop(const int xPosition, const int yPosition);
+        inline bool getIsPawn(const int xPosition, const int yPosition);
+        
+};
+
+char getXPositionSymbol(const int xPosition);
+
+//Число ходов не задано (EPD без операции "dm")
+const int NoMovesAmount = -1;
+
+//Допустимо ли число ходов: хотя бы один ход и 2 * nMoves - 1 полуходов не больше
+//Chess::MaxPlys - 1 (сравнение без умножения - nMoves может прийти из непроверенного файла)
+inline bool getIsMovesAmountAllowed(const int nMoves){return nMoves >= 1 && nMoves <= Chess::MaxPlys / 2;}
+
+//Разобранная задача (из FEN/EPD или целочисленного формата). Расстановка
+//хранится в массиве, разбор не выделяет память и не копирует текст
+struct parsedProblem
+{
+    bool isWhiteFirst;
+    int castlingPermits; //биты 1, 2 - белые O-O, O-O-O; 4, 8 - черные
+                         //или Chess::CastlingByPosition
+    bool isEnPassantPossible;
+    int xPawnPosIfEnPassant;
+    int yPawnPosIfEnPassant;
+    int nMoves; //число ходов; для EPD - операция "dm N", NoMovesAmount - не задано
+    const char *id; //операция EPD "id" - указатель в разобранный текст
+    int idLength;
+    int piecesAmount;
+    Chess::pieceForIn pieces[Chess::DeskSizeX * Chess::DeskSizeY];
+};
+
+//Разбор задач (без выделения памяти) и загрузка разобранной задачи в Chess
+bool parseFen(const char * const text, parsedProblem * const problem);
+bool parseIntegerProblem(const char * const text, const char * const end,
+                         parsedProblem * const problem, const char ** const next);
+void mirrorProblem(parsedProblem * const problem);
+bool loadParsedProblem(parsedProblem * const problem, Chess * const chess,
+                       const bool isMirror, const int defaultMoves);
+bool loadChessProblemFromFen(const char * const text, Chess * const chess,
+                             const bool isMirror, const int defaultMoves,
+                             std::string * const id);
+
+//Двоичный формат задач и итогов: заголовок (сигнатура, версия, размер
+//записи), далее записи постоянной длины - к задаче или итогу номер N
+//можно перейти сразу, файлы легко делить на части и сравнивать.
+//Числа записываются младшим байтом вперед
+enum BinaryFormat : int
+{
+    BinaryHeaderSize = 16,
+    BinaryVersion = 1,
+    
+    //запись задачи: 32 байта расстановки (по полубайту на поле, a1, b1, ...,
+    //h8; 1-6 - белые фигуры, 9-14 - черные), флаги, поле пешки, сходившей
+    //на два поля, число ходов (0 - не задано), резерв
+    BinaryProblemSize = 36,
+    BinaryWhiteFirst = 1,
+    BinaryCastlingShift = 1, //биты прав на рокировку (castlingPermits) - 1..4
+    BinaryCastlingByPosition = 0x20,
+    BinaryEnPassant = 0x40,
+    
+    //запись итога: номер задачи, состояние, режим, ключ (символ фигуры,
+    //поля), число ключей, резерв, результат solveProblem, узлы, микросекунды
+    BinaryResultSize = 32
+};
+
+//Вид двоичного файла: задачи или итоги пакета
+enum BinaryFileType : int
+{
+    BinaryProblemsFile = 0,
+    BinaryResultsFile = 1
+};
+
+//Итог задачи пакета - запись двоичного файла итогов
+struct binaryResult
+{
+    int index; //номер задачи в пакете
+    int status; //0 - задача не загружена, 1 - мат найден, 2 - мата нет,
+                //3 - исчерпан предел числа узлов
+    int mode; //как печатается результат: 0 - число путей, 1 - ключи, 2 - кратчайший мат
+    int keysAmount;
+    Chess::plyForOut key; //первый ключ (символ фигуры и поля), если keysAmount > 0
+    int result; //результат solveProblem
+    unsigned long long nodes;
+    unsigned long long microseconds;
+};
+
+bool writeBinaryHeader(FILE * const f, const BinaryFileType type);
+bool getIsBinaryHeader(const char * const data, const size_t size, const BinaryFileType type);
+bool writeBinaryProblem(FILE * const f, const parsedProblem * const problem);
+bool parseBinaryProblem(const unsigned char * const record, parsedProblem * const problem);
+bool writeBinaryResult(FILE * const f, const binaryResult * const result);
+void parseBinaryResult(const unsigned char * const record, binaryResult * const result);
+
+//Формат набора задач
+enum CorpusFormat : int
+{
+    IntegerCorpus = 0,
+    FenCorpus = 1,
+    BinaryCorpus = 2
+};
+
+//Набор задач в одном файле - целочисленный формат (задачи подряд), EPD
+//(по задаче в строке) или двоичный. Файл отображается в память, при открытии
+//строится только индекс начал задач (у двоичного - не нужен); сами задачи
+//разбираются на месте по номеру, так что потоки могут брать себе диапазоны номеров
+struct problemCorpus
+{
+    std::string fileName;
+    const char *data;
+    size_t size;
+    void *mapping; //NULL - файл прочитан в buffer
+    std::vector<char> buffer;
+    CorpusFormat format;
+    std::vector<size_t> offsets; //начала задач в data
+};
+
+bool mapCorpusFile(const std::string fileName, problemCorpus * const corpus);
+bool openCorpus(const std::string fileName, problemCorpus * const corpus);
+void closeCorpus(problemCorpus * const corpus);
+
+inline size_t getCorpusProblemsAmount(const problemCorpus * const corpus)
+{
+    if(corpus->format == BinaryCorpus)
+        {return (corpus->size - BinaryHeaderSize) / BinaryProblemSize;}
+    return corpus->offsets.size();
+}
+
+bool parseCorpusProblem(const problemCorpus * const corpus, const size_t index,
+                        parsedProblem * const problem);
+
+bool loadChessProblemFromFile(const std::string fileName,
+                              Chess * const chess, const bool isMirror,
+                              const int defaultMoves);
+
+void printResolution(std::list< std::list<Chess::plyForOut> > * const solutions);
+
+//Получатель, печатающий каждый путь решения сразу, как он установлен
+//(в том же виде, что и printResolution)
+class resolutionPrinter : public Chess::solutionVisitor
+{
+    public:
+        void visitPath(const Chess::plyForOut * const path, const int pathLength)
+        {
+            for(int i = 0; i < pathLength; i++)
+            {
+                printf("  %c%c%d-%c%d", path[i].pieceSymbol,
+                       getXPositionSymbol(path[i].xSourceField),
+                       path[i].ySourceField,
+                       getXPositionSymbol(path[i].xDestinationField),
+                       path[i].yDestinationField);
+            }
+            printf("\n");
+            fflush(stdout);
+        }
+};
+
+//Параметры решения, общие для одиночного и пакетного режимов
+struct solveOptions
+{
+    int hashMegaBytes;
+    int threadsAmount;
+    int proofNodesLimit;
+    bool isShortest;
+    bool isProofNumber;
+    bool isKeyOnly;
+    bool isCooksCounting;
+};
+
+int solveProblem(Chess * const chess, const solveOptions * const options,
+                 Chess::solutionVisitor * const visitor);
+std::string getPlyText(const Chess::plyForOut &ply);
+
+#endif
@@ -0,0 +1,1011 @@
+#include "chess.h"
+
+#include <filesystem>
+#include <map>
+#ifdef _WIN32
+    #include <process.h>
+#else
+    #include <unistd.h>
+#endif
+
+//Замена глобальных operator new/delete: счетчик выделений памяти в куче
+static std::atomic<unsigned long long> heapAllocationsAmount(0);
+
+#ifdef __GNUC__
+    //встраивание пары malloc/free в вызовы new/delete дает ложные
+    //предупреждения -Wmismatched-new-delete
+    #define NOT_INLINED __attribute__((noinline))
+#else
+    #define NOT_INLINED
+#endif
+
+NOT_INLINED void *operator new(size_t size)
+{
+    heapAllocationsAmount.fetch_add(1, std::memory_order_relaxed);
+    void *memory = malloc(size > 0 ? size : 1);
+    if(memory == NULL){throw std::bad_alloc();}
+    return memory;
+}
+
+NOT_INLINED void operator delete(void *memory) noexcept {free(memory);}
+NOT_INLINED void operator delete(void *memory, size_t) noexcept {free(memory);}
+
+static unsigned long long getHeapAllocationsAmount()
+{
+    return heapAllocationsAmount.load(std::memory_order_relaxed);
+}
+
+void test1()
+{
+    std::string fileNameIn, fileNameOut, fileNameOutB;
+    for(int q = 1; q <= 6; q++)
+    {
+    
+        switch(q)
+        {
+            case 1:
+            {
+                fileNameIn = "chess_test_01.txt";
+                fileNameOut = "chess_test_01_out.txt";
+                fileNameOutB = "chess_test_01_b_out.txt";
+                break;
+            }
+            case 2:
+            {
+                fileNameIn = "chess_test_02.txt";
+                fileNameOut = "chess_test_02_out.txt";
+                fileNameOutB = "chess_test_02_b_out.txt";
+                break;
+            }
+            case 3:
+            {
+                fileNameIn = "chess_test_03.txt";
+                fileNameOut = "chess_test_03_out.txt";
+                fileNameOutB = "chess_test_03_b_out.txt";
+                break;
+            }
+            case 4:
+            {
+                fileNameIn = "chess_test_04.txt";
+                fileNameOut = "chess_test_04_out.txt";
+                fileNameOutB = "chess_test_04_b_out.txt";
+                break;
+            }
+            case 5:
+            {
+                fileNameIn = "chess_test_05.txt";
+                fileNameOut = "chess_test_05_out.txt";
+                fileNameOutB = "chess_test_05_b_out.txt";
+                break;
+            }
+            case 6:
+            {
+                fileNameIn = "chess_test_06.txt";
+                fileNameOut = "chess_test_06_out.txt";
+                fileNameOutB = "chess_test_06_b_out.txt";
+                break;
+            }
+        }
+        
+        Chess problem01;
+        
+        printf(fileNameIn.c_str());
+        printf("\n");
+        loadChessProblemFromFile(fileNameIn.c_str(), &problem01, false, 0);
+        
+        //problem01.printDesk(false, 0, 0);
+        
+        printf(fileNameIn.c_str());
+        printf("\n");
+        FILE *f;
+        f = fopen(fileNameOut.c_str(), "r");
+        assert(f != 0);
+        assert(problem01.testGenerator(f));
+        fclose(f);
+        
+        Chess problem02;
+        
+        loadChessProblemFromFile(fileNameIn.c_str(), &problem02, true, 0);
+        
+        printf(fileNameOutB.c_str());
+        printf("\n");
+        f = fopen(fileNameOutB.c_str(), "r");
+        assert(f != 0);
+        assert(problem02.testGenerator(f));
+        fclose(f);
+            
+    }
+}
+
+//Имена файлов пакета: каталог раскрывается в список своих файлов
+//(по алфавиту), "@список" - файл со списком имен (по одному в строке),
+//остальное - имя файла задачи (файл может содержать набор задач)
+bool collectBatchFiles(const std::string name, std::vector<std::string> * const fileNames)
+{
+    std::error_code error;
+    if(name.size() > 1 && name[0] == '@')
+    {
+        FILE *f = fopen(name.c_str() + 1, "r");
+        if(f == 0)
+        {
+            printf("File can't be open or doesn't exist (check the file name)\n");
+            return false;
+        }
+        char line[4096];
+        while(fgets(line, sizeof(line), f) != NULL)
+        {
+            std::string fileName = line;
+            while(!fileName.empty() && (fileName.back() == '\n' || fileName.back() == '\r' ||
+                                        fileName.back() == ' '))
+                {fileName.pop_back();}
+            if(!fileName.empty()){fileNames->push_back(fileName);}
+        }
+        fclose(f);
+    }
+    else if(std::filesystem::is_directory(name, error))
+    {
+        std::vector<std::string> directoryFiles;
+        for(const std::filesystem::directory_entry &entry :
+            std::filesystem::directory_iterator(name, error))
+        {
+            if(entry.is_regular_file(error)){directoryFiles.push_back(entry.path().string());}
+        }
+        std::sort(directoryFiles.begin(), directoryFiles.end());
+        fileNames->insert(fileNames->end(), directoryFiles.begin(), directoryFiles.end());
+    }
+    else
+        {fileNames->push_back(name);}
+    
+    return true;
+}
+
+//Результат решения одной задачи пакета
+struct batchResult
+{
+    std::string name; //имя файла или "файл:номер задачи" для наборов задач
+    bool isLoaded;
+    int result; //как у solveProblem
+    std::string keys; //первые ходы найденных решений
+    Chess::plyForOut key; //первый из них
+    int keysAmount;
+    double seconds;
+    unsigned long long nodes;
+};
+
+//Получатель ключей задачи пакета: ключи - различные первые ходы путей,
+//сами пути не хранятся
+class keysCollector : public Chess::solutionVisitor
+{
+    public:
+        explicit keysCollector(batchResult * const result) : result(result) {}
+        
+        void visitPath(const Chess::plyForOut * const path, const int pathLength)
+        {
+            if(pathLength == 0){return;}
+            std::string key = getPlyText(path[0]);
+            if(key == previousKey){return;}
+            if(!result->keys.empty()){result->keys += " ";}
+            result->keys += key;
+            previousKey = key;
+            if(result->keysAmount++ == 0){result->key = path[0];}
+        }
+        
+    private:
+        batchResult *result;
+        std::string previousKey;
+};
+
+void printBatchResult(const batchResult * const result, const solveOptions * const options)
+{
+    printf("%s: ", result->name.c_str());
+    if(!result->isLoaded){printf("load error\n"); return;}
+    
+    if(result->result == 0)
+        {printf("no mate");}
+    else if(result->result < 0)
+        {printf("proof nodes limit reached");}
+    else if(options->isKeyOnly)
+        {printf("keys %s", result->keys.c_str());}
+    else if(options->isShortest)
+        {printf("mate in %d, key %s", result->result, result->keys.c_str());}
+    else
+        {printf("%d paths, key %s", result->result, result->keys.c_str());}
+    printf(", %.3f s, %llu nodes\n", result->seconds, result->nodes);
+}
+
+//Двоичная запись итога задачи пакета
+bool writeBatchResult(FILE * const f, const int index, const batchResult * const result,
+                      const solveOptions * const options)
+{
+    binaryResult record;
+    record.index = index;
+    record.status = !result->isLoaded ? 0 : result->result > 0 ? 1 : result->result == 0 ? 2 : 3;
+    record.mode = options->isKeyOnly ? 1 : options->isShortest ? 2 : 0;
+    record.keysAmount = result->keysAmount;
+    record.key = result->key;
+    record.result = result->result;
+    record.nodes = result->nodes;
+    record.microseconds = (unsigned long long)(result->seconds * 1000000.0 + 0.5);
+    return writeBinaryResult(f, &record);
+}
+
+//Итог задачи пакета из двоичной записи; index - номер задачи в пакете
+void parseBatchResult(const unsigned char * const record, int * const index,
+                      batchResult * const result, solveOptions * const options)
+{
+    binaryResult parsed;
+    parseBinaryResult(record, &parsed);
+    *index = parsed.index;
+    result->name = "#" + std::to_string(*index + 1);
+    result->isLoaded = parsed.status != 0;
+    options->isKeyOnly = parsed.mode == 1;
+    options->isShortest = parsed.mode == 2;
+    result->keysAmount = parsed.keysAmount;
+    result->keys.clear();
+    if(result->keysAmount > 0)
+    {
+        result->key = parsed.key;
+        //в записи хранится только первый ключ
+        result->keys = getPlyText(result->key);
+        if(result->keysAmount > 1){result->keys += " (+" + std::to_string(result->keysAmount - 1) + ")";}
+    }
+    result->result = parsed.result;
+    result->nodes = parsed.nodes;
+    result->seconds = parsed.microseconds / 1000000.0;
+}
+
+//Печать итогов пакета из двоичного файла
+bool printBinaryResults(const std::string fileName)
+{
+    problemCorpus results;
+    results.fileName = fileName;
+    if(!mapCorpusFile(fileName, &results))
+    {
+        printf("File can't be open or doesn't exist (check the file name)\n");
+        return false;
+    }
+    if(!getIsBinaryHeader(results.data, results.size, BinaryResultsFile))
+    {
+        printf("%s: not a results file\n", fileName.c_str());
+        closeCorpus(&results);
+        return false;
+    }
+    
+    size_t resultsAmount = (results.size - BinaryHeaderSize) / BinaryResultSize;
+    for(size_t i = 0; i < resultsAmount; i++)
+    {
+        int index;
+        batchResult result;
+        solveOptions options = {};
+        parseBatchResult((const unsigned char *)results.data + BinaryHeaderSize +
+                         i * BinaryResultSize, &index, &result, &options);
+        printBatchResult(&result, &options);
+    }
+    closeCorpus(&results);
+    return true;
+}
+
+//Открытый файл пакета: закрывается, когда розданы и разобраны все его задачи
+struct batchCorpus
+{
+    problemCorpus corpus;
+    bool isOpen; //false - файл не открылся
+    size_t nextProblem;
+    int activeRanges;
+};
+
+//Источник задач пакета: файлы открываются по очереди, потокам выдаются
+//диапазоны номеров задач текущего файла
+struct batchSource
+{
+    const std::vector<std::string> *fileNames;
+    size_t nextFile;
+    std::list<batchCorpus> corpora;
+    int nextIndex;
+    std::mutex mutex;
+};
+
+//Диапазон задач файла, выданный потоку
+struct batchRange
+{
+    std::list<batchCorpus>::iterator corpus;
+    size_t first;
+    size_t last;
+    int firstIndex; //порядковый номер первой задачи - итоги печатаются в этом порядке
+};
+
+static const size_t BatchRangeSize = 16; //задач в одном диапазоне
+
+bool getNextBatchRange(batchSource * const source, batchRange * const range)
+{
+    std::lock_guard<std::mutex> lock(source->mutex);
+    for(;;)
+    {
+        if(!source->corpora.empty())
+        {
+            std::list<batchCorpus>::iterator current = --source->corpora.end();
+            size_t problemsAmount = current->isOpen ?
+                                    getCorpusProblemsAmount(&current->corpus) : 1;
+            if(current->nextProblem < problemsAmount)
+            {
+                range->corpus = current;
+                range->first = current->nextProblem;
+                range->last = std::min(problemsAmount, range->first + BatchRangeSize);
+                range->firstIndex = source->nextIndex;
+                source->nextIndex += (int)(range->last - range->first);
+                current->nextProblem = range->last;
+                current->activeRanges++;
+                return true;
+            }
+        }
+        if(source->nextFile >= source->fileNames->size()){return false;}
+        
+        //неоткрывающийся файл попадет в итоги как ошибка загрузки
+        source->corpora.emplace_back();
+        batchCorpus *next = &source->corpora.back();
+        next->isOpen = openCorpus((*source->fileNames)[source->nextFile++], &next->corpus);
+        next->nextProblem = 0;
+        next->activeRanges = 0;
+        if(next->isOpen && getCorpusProblemsAmount(&next->corpus) == 0)
+        {
+            closeCorpus(&next->corpus);
+            source->corpora.pop_back();
+        }
+    }
+}
+
+void finishBatchRange(batchSource * const source, const batchRange * const range)
+{
+    std::lock_guard<std::mutex> lock(source->mutex);
+    batchCorpus *corpus = &*range->corpus;
+    corpus->activeRanges--;
+    size_t problemsAmount = corpus->isOpen ? getCorpusProblemsAmount(&corpus->corpus) : 1;
+    if(corpus->activeRanges == 0 && corpus->nextProblem >= problemsAmount)
+    {
+        if(corpus->isOpen){closeCorpus(&corpus->corpus);}
+        source->corpora.erase(range->corpus);
+    }
+}
+
+//Пакетное решение: задачи раздаются jobsAmount потокам, у каждого потока
+//свой экземпляр Chess. Итоги печатаются в порядке списка файлов (и задач
+//внутри файлов) по мере готовности. defaultMoves - число ходов для FEN без "dm";
+//resultsFileName (может быть NULL) - файл для итогов в двоичном формате;
+//isPrinting - печать итогов задач и сводки
+void solveBatch(const std::vector<std::string> * const fileNames, const int jobsAmount,
+                const int defaultMoves, const solveOptions * const options,
+                const char * const resultsFileName, const bool isPrinting)
+{
+    FILE *resultsFile = NULL;
+    if(resultsFileName != NULL)
+    {
+        resultsFile = fopen(resultsFileName, "wb");
+        if(resultsFile == 0 || !writeBinaryHeader(resultsFile, BinaryResultsFile))
+        {
+            printf("%s: can't write results\n", resultsFileName);
+            if(resultsFile != 0){fclose(resultsFile);}
+            return;
+        }
+    }
+    
+
+    batchSource source;
+    source.fileNames = fileNames;
+    source.nextFile = 0;
+    source.nextIndex = 0;
+    
+    //готовые итоги ждут печати, пока не напечатаны все предыдущие
+    std::map<int, batchResult> finished;
+    std::mutex printMutex;
+    int nextPrinted = 0;
+    int problemsAmount = 0;
+    int solvedAmount = 0;
+    int errorsAmount = 0;
+    unsigned long long nodesAmount = 0;
+    
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    
+    std::vector<std::thread> jobs;
+    for(int t = 0; t < jobsAmount; t++)
+    {
+        jobs.push_back(std::thread([&]()
+        {
+            batchRange range;
+            parsedProblem problem;
+            //один решатель на поток: загрузка задачи сбрасывает его
+            //с сохранением буферов и таблицы транспозиций
+            Chess chess;
+            chess.setIsPrinting(false);
+            while(getNextBatchRange(&source, &range))
+            {
+                const problemCorpus *corpus = range.corpus->isOpen ? &range.corpus->corpus : NULL;
+                for(size_t i = range.first; i < range.last; i++)
+                {
+                    batchResult result;
+                    std::chrono::steady_clock::time_point problemStart = std::chrono::steady_clock::now();
+                    
+                    //в наборе из нескольких задач - "файл:номер задачи"
+                    result.name = range.corpus->corpus.fileName;
+                    if(corpus != NULL && getCorpusProblemsAmount(corpus) > 1)
+                        {result.name += ":" + std::to_string(i + 1);}
+                    
+                    result.isLoaded = corpus != NULL && parseCorpusProblem(corpus, i, &problem);
+                    if(result.isLoaded && problem.idLength > 0)
+                        {result.name += " " + std::string(problem.id, problem.idLength);}
+                    result.isLoaded = result.isLoaded &&
+                                      loadParsedProblem(&problem, &chess, false, defaultMoves);
+                    result.result = 0;
+                    result.nodes = 0;
+                    result.keysAmount = 0;
+                    if(result.isLoaded)
+                    {
+                        keysCollector collector(&result);
+                        result.result = solveProblem(&chess, options, &collector);
+                        result.nodes = chess.getNodesAmount();
+                    }
+                    result.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() -
+                                                                   problemStart).count();
+                    
+                    std::lock_guard<std::mutex> lock(printMutex);
+                    finished[range.firstIndex + (int)(i - range.first)] = result;
+                    while(!finished.empty() && finished.begin()->first == nextPrinted)
+                    {
+                        const batchResult *printed = &finished.begin()->second;
+                        if(isPrinting){printBatchResult(printed, options);}
+                        if(resultsFile != NULL)
+                            {writeBatchResult(resultsFile, nextPrinted, printed, options);}
+                        problemsAmount++;
+                        if(!printed->isLoaded){errorsAmount++;}
+                        else if(printed->result > 0){solvedAmount++;}
+                        nodesAmount += printed->nodes;
+                        finished.erase(finished.begin());
+                        nextPrinted++;
+                    }
+                    fflush(stdout);
+                }
+                finishBatchRange(&source, &range);
+            }
+        }));
+    }
+    for(int t = 0; t < jobsAmount; t++){jobs[t].join();}
+    if(resultsFile != NULL){fclose(resultsFile);}
+    if(!isPrinting){return;}
+    
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() -
+                                                   start).count();
+    
+    printf("\nPROBLEMS: %d, SOLVED: %d, NO MATE: %d, ERRORS: %d\n", problemsAmount,
+           solvedAmount, problemsAmount - solvedAmount - errorsAmount, errorsAmount);
+    printf("TIME: %.3f s, JOBS: %d, %.1f problems/s, %llu nodes\n", seconds, jobsAmount,
+           seconds > 0 ? problemsAmount / seconds : 0.0, nodesAmount);
+}
+
+//Замер скорости чтения наборов задач: файлы отображаются в память,
+//все задачи разбираются в одном потоке, без решения
+void scanCorpora(const std::vector<std::string> * const fileNames)
+{
+    long long problemsAmount = 0;
+    long long errorsAmount = 0;
+    parsedProblem problem;
+    
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    for(size_t f = 0; f < fileNames->size(); f++)
+    {
+        problemCorpus corpus;
+        if(!openCorpus((*fileNames)[f], &corpus))
+        {
+            printf("%s: load error\n", (*fileNames)[f].c_str());
+            errorsAmount++;
+            continue;
+        }
+        size_t amount = getCorpusProblemsAmount(&corpus);
+        for(size_t i = 0; i < amount; i++)
+        {
+            if(!parseCorpusProblem(&corpus, i, &problem)){errorsAmount++;}
+        }
+        problemsAmount += amount;
+        closeCorpus(&corpus);
+    }
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() -
+                                                   start).count();
+    
+    printf("PROBLEMS: %lld, ERRORS: %lld\n", problemsAmount, errorsAmount);
+    printf("TIME: %.3f s, %.0f problems/s\n", seconds,
+           seconds > 0 ? problemsAmount / seconds : 0.0);
+}
+
+//Перевод наборов задач в двоичный формат; неразбираемые задачи
+//пропускаются, для задач EPD без "dm" число ходов - defaultMoves;
+//isPrinting - печать сводки
+bool packCorpora(const std::vector<std::string> * const fileNames, const char * const packName,
+                 const int defaultMoves, const bool isPrinting)
+{
+    FILE *pack = fopen(packName, "wb");
+    if(pack == 0 || !writeBinaryHeader(pack, BinaryProblemsFile))
+    {
+        printf("%s: can't write problems\n", packName);
+        if(pack != 0){fclose(pack);}
+        return false;
+    }
+    
+    long long problemsAmount = 0;
+    long long errorsAmount = 0;
+    parsedProblem problem;
+    for(size_t f = 0; f < fileNames->size(); f++)
+    {
+        problemCorpus corpus;
+        if(!openCorpus((*fileNames)[f], &corpus))
+        {
+            printf("%s: load error\n", (*fileNames)[f].c_str());
+            errorsAmount++;
+            continue;
+        }
+        size_t amount = getCorpusProblemsAmount(&corpus);
+        for(size_t i = 0; i < amount; i++)
+        {
+            if(!parseCorpusProblem(&corpus, i, &problem)){errorsAmount++; continue;}
+            if(problem.nMoves == NoMovesAmount){problem.nMoves = defaultMoves;}
+            writeBinaryProblem(pack, &problem);
+            problemsAmount++;
+        }
+        closeCorpus(&corpus);
+    }
+    bool isWritten = fclose(pack) == 0;
+    
+    if(isPrinting){printf("PACKED: %lld, ERRORS: %lld\n", problemsAmount, errorsAmount);}
+    return isWritten;
+}
+
+//Позиция для perft из строки FEN (fen не NULL) или из файла. Число ходов
+//на подсчет не влияет, поэтому FEN без "dm" загружается и без -dm
+bool loadPerftPosition(const char * const fen, const char * const fileName,
+                       const int defaultMoves, Chess * const position)
+{
+    const int perftMoves = std::max(defaultMoves, 1);
+    return fen != NULL ? loadChessProblemFromFen(fen, position, false, perftMoves, NULL) :
+                         loadChessProblemFromFile(fileName, position, false, perftMoves);
+}
+
+#ifndef NDEBUG
+//Проверка строки файла-образца: line - строка входного файла (index - ее номер
+//от 0), expected - соответствующая строка файла ожидаемых итогов
+class fixtureChecker
+{
+    public:
+        virtual ~fixtureChecker(){}
+        virtual bool check(const int index, const char * const line, const char * const expected) = 0;
+};
+
+//Построчная сверка файла-образца с файлом ожидаемых итогов;
+//возвращает число проверенных строк
+int testFixture(const char * const fixtureName, const char * const outName,
+                fixtureChecker * const checker)
+{
+    printf("%s\n", fixtureName);
+    FILE *fIn = fopen(fixtureName, "r");
+    assert(fIn != 0);
+    FILE *fOut = fopen(outName, "r");
+    assert(fOut != 0);
+    
+    char line[4096];
+    char expected[256];
+    int index = 0;
+    for(; fgets(line, sizeof(line), fIn) != NULL; index++)
+    {
+        bool isExpected = fgets(expected, sizeof(expected), fOut) != NULL;
+        assert(isExpected);
+        if(!checker->check(index, line, expected))
+        {
+            printf("%s:%d: %s", fixtureName, index + 1, line);
+            fflush(stdout);
+            assert(false);
+        }
+    }
+    bool isOutEnded = fgets(expected, sizeof(expected), fOut) == NULL;
+    assert(isOutEnded);
+    fclose(fOut);
+    fclose(fIn);
+    return index;
+}
+
+//Задачи с ходом черных (EPD): число путей решения и ключ в обозначениях
+//исходной задачи ("пути ключ" в строке итогов)
+class blackFirstChecker : public fixtureChecker
+{
+    public:
+        blackFirstChecker(){chess.setIsPrinting(false);}
+        
+        bool check(const int, const char * const line, const char * const expected)
+        {
+            int pathsAmount = 0;
+            char key[16];
+            parsedProblem problem;
+            if(sscanf(expected, "%d %15s", &pathsAmount, key) != 2 || !parseFen(line, &problem) ||
+               !loadParsedProblem(&problem, &chess, false, 0))
+                {return false;}
+            
+            std::list< std::list<Chess::plyForOut> > solutions;
+            return chess.compute(&solutions) == pathsAmount && !solutions.empty() &&
+                   getPlyText(solutions.front().front()) == key;
+        }
+        
+    private:
+        Chess chess;
+};
+
+void test2()
+{
+    blackFirstChecker checker;
+    testFixture("chess_test_black.txt", "chess_test_black_out.txt", &checker);
+}
+
+//perft известных позиций (FEN без "dm", загрузка как у -perft) сверяется
+//с эталонным числом листьев ("глубина число" в строке итогов)
+class perftChecker : public fixtureChecker
+{
+    public:
+        bool check(const int, const char * const line, const char * const expected)
+        {
+            int depth = 0;
+            unsigned long long nodes = 0;
+            if(sscanf(expected, "%d %llu", &depth, &nodes) != 2 ||
+               !loadPerftPosition(line, NULL, 0, &chess))
+                {return false;}
+            
+            printf("perft(%d) %llu\n", depth, nodes);
+            return chess.perft(depth) == nodes;
+        }
+        
+    private:
+        Chess chess;
+};
+
+void test3()
+{
+    perftChecker checker;
+    testFixture("chess_test_perft.txt", "chess_test_perft_out.txt", &checker);
+}
+
+//Разбор строк FEN/EPD: 1 - задача загружается, 2 - строка верна, но задача
+//отклоняется при загрузке (нет "dm" или слишком много ходов), 0 - строка неверна
+class fenChecker : public fixtureChecker
+{
+    public:
+        bool check(const int, const char * const line, const char * const expected)
+        {
+            int result = 0;
+            parsedProblem problem;
+            if(parseFen(line, &problem))
+                {result = loadParsedProblem(&problem, &chess, false, 0) ? 1 : 2;}
+            return result == atoi(expected);
+        }
+        
+    private:
+        Chess chess;
+};
+
+void test4()
+{
+    fenChecker checker;
+    testFixture("chess_test_fen.txt", "chess_test_fen_out.txt", &checker);
+}
+
+//Имя временного файла, свое у каждого процесса
+std::string getTempFileName(const char * const name)
+{
+    #ifdef _WIN32
+        int processId = _getpid();
+    #else
+        int processId = (int)getpid();
+    #endif
+    return (std::filesystem::temp_directory_path() /
+            (std::string(name) + "_" + std::to_string(processId) + ".bin")).string();
+}
+
+//Расстановка задачи на доске 8x8 (для сравнения задач с разным порядком фигур)
+void getProblemBoard(const parsedProblem * const problem,
+                     int board[Chess::DeskSizeX * Chess::DeskSizeY])
+{
+    for(int i = 0; i < Chess::DeskSizeX * Chess::DeskSizeY; i++){board[i] = Chess::Empty;}
+    for(int i = 0; i < problem->piecesAmount; i++)
+    {
+        const Chess::pieceForIn *piece = &problem->pieces[i];
+        board[(piece->yPosition - 1) * Chess::DeskSizeX + piece->xPosition - 1] = piece->pieceType;
+    }
+}
+
+//Двоичные форматы: задачи EPD переводятся в двоичный файл (-pack) и решаются
+//из него пакетом с записью итогов (-results). Задачи двоичного файла должны
+//совпасть с исходными, прочитанные итоги - со строкой "пути ключ"
+//("-" без ключа)
+class roundtripChecker : public fixtureChecker
+{
+    public:
+        explicit roundtripChecker(const char * const fixtureName) :
+            packName(getTempFileName("chess_test_pack")),
+            resultsName(getTempFileName("chess_test_results"))
+        {
+            std::vector<std::string> fileNames(1, fixtureName);
+            bool isPacked = packCorpora(&fileNames, packName.c_str(), 0, false);
+            assert(isPacked);
+            
+            solveOptions options = {};
+            options.hashMegaBytes = Chess::DefaultHashMegaBytes;
+            options.threadsAmount = 1;
+            options.proofNodesLimit = Chess::DefaultProofNodesLimit;
+            std::vector<std::string> packFiles(1, packName);
+            solveBatch(&packFiles, 2, 0, &options, resultsName.c_str(), false);
+            
+            bool isOpen = openCorpus(packName, &pack) && pack.format == BinaryCorpus &&
+                          mapCorpusFile(resultsName, &results) &&
+                          getIsBinaryHeader(results.data, results.size, BinaryResultsFile);
+            assert(isOpen);
+        }
+        
+        ~roundtripChecker()
+        {
+            closeCorpus(&results);
+            closeCorpus(&pack);
+            std::filesystem::remove(packName);
+            std::filesystem::remove(resultsName);
+        }
+        
+        bool check(const int index, const char * const line, const char * const expected)
+        {
+            int pathsAmount = 0;
+            char key[16];
+            parsedProblem problem, packedProblem;
+            if(sscanf(expected, "%d %15s", &pathsAmount, key) != 2 || !parseFen(line, &problem) ||
+               (size_t)index >= getResultsAmount() ||
+               !parseCorpusProblem(&pack, index, &packedProblem))
+                {return false;}
+            
+            int board[Chess::DeskSizeX * Chess::DeskSizeY];
+            int packedBoard[Chess::DeskSizeX * Chess::DeskSizeY];
+            getProblemBoard(&problem, board);
+            getProblemBoard(&packedProblem, packedBoard);
+            if(packedProblem.isWhiteFirst != problem.isWhiteFirst ||
+               packedProblem.castlingPermits != problem.castlingPermits ||
+               packedProblem.isEnPassantPossible != problem.isEnPassantPossible ||
+               packedProblem.xPawnPosIfEnPassant != problem.xPawnPosIfEnPassant ||
+               packedProblem.yPawnPosIfEnPassant != problem.yPawnPosIfEnPassant ||
+               packedProblem.nMoves != problem.nMoves ||
+               memcmp(board, packedBoard, sizeof(board)) != 0)
+                {return false;}
+            
+            int resultIndex;
+            batchResult result;
+            solveOptions options = {};
+            parseBatchResult((const unsigned char *)results.data + BinaryHeaderSize +
+                             index * BinaryResultSize, &resultIndex, &result, &options);
+            return resultIndex == index && result.isLoaded && result.result == pathsAmount &&
+                   (result.keysAmount > 0 ? getPlyText(result.key) : "-") == key;
+        }
+        
+        size_t getProblemsAmount() const {return getCorpusProblemsAmount(&pack);}
+        size_t getResultsAmount() const {return (results.size - BinaryHeaderSize) / BinaryResultSize;}
+        
+    private:
+        std::string packName;
+        std::string resultsName;
+        problemCorpus pack;
+        problemCorpus results;
+};
+
+void test5()
+{
+    roundtripChecker checker("chess_test_pack.txt");
+    int problemsAmount = testFixture("chess_test_pack.txt", "chess_test_pack_out.txt", &checker);
+    assert((size_t)problemsAmount == checker.getProblemsAmount() &&
+           (size_t)problemsAmount == checker.getResultsAmount());
+}
+#endif
+
+int main(int argc, char *argv[])
+{
+    //Запуск:
+    //  chess_pr [-hash <МБ>] [-threads <N>] [-shortest] [файл задачи] - решение задачи
+    //                                            (по умолчанию chess_01.txt),
+    //                                            -threads - число потоков,
+    //                                            -shortest - поиск кратчайшего мата
+    //  chess_pr -key | -cooks [-hash <МБ>] [-threads <N>] [файл задачи] - только ключ решения,
+    //                                            -cooks - все ключи (побочные решения)
+    //  chess_pr -pns [-pnsnodes <число узлов>] [файл задачи] - поиск по числам доказательства
+    //  chess_pr -perft <глубина> [файл задачи] - подсчёт perft с разбивкой по первому полуходу
+    //  chess_pr -batch [-jobs <N>] [ключи решения] <файлы, каталоги, @списки> - пакетное
+    //                                            решение на N потоках (по умолчанию - по
+    //                                            числу ядер), файл может содержать набор задач
+    //                                            (целочисленный формат или EPD)
+    //  chess_pr -scan <файлы, каталоги, @списки> - замер скорости чтения наборов задач
+    //  chess_pr -pack <файл> <файлы, каталоги, @списки> - перевод задач в двоичный формат
+    //  -results <файл> - итоги пакетного решения в двоичном формате
+    //  chess_pr -showresults <файл> - печать двоичных итогов
+    //  chess_pr -fen "<FEN/EPD>" [ключи решения] - задача в нотации FEN/EPD
+    //  -dm <N> - число ходов для FEN/EPD без операции "dm"
+    
+    #ifndef NDEBUG
+        printf("DEBUG MODE\n\n");
+    #endif
+    
+    setHeapAllocationsCounter(getHeapAllocationsAmount);
+    
+    const char *fileName = "chess_01.txt";
+    int perftDepth = 0;
+    int hashMegaBytes = Chess::DefaultHashMegaBytes;
+    bool isShortest = false;
+    bool isProofNumber = false;
+    bool isKeyOnly = false;
+    bool isAllocationsReporting = false;
+    bool isCooksCounting = false;
+    int proofNodesLimit = Chess::DefaultProofNodesLimit;
+    int threadsAmount = Chess::DefaultThreadsAmount;
+    bool isBatch = false;
+    bool isScan = false;
+    const char *packName = NULL;
+    const char *resultsName = NULL;
+    const char *shownResultsName = NULL;
+    int jobsAmount = (int)std::thread::hardware_concurrency();
+    if(jobsAmount < 1){jobsAmount = 1;}
+    std::vector<std::string> batchNames;
+    const char *fen = NULL;
+    int defaultMoves = 0;
+    
+    for(int i = 1; i < argc; i++)
+    {
+        if(strcmp(argv[i], "-perft") == 0 && i + 1 < argc)
+        {
+            perftDepth = atoi(argv[++i]);
+            if(perftDepth < 1)
+            {
+                printf("incorrect perft depth.\n");
+                return 1;
+            }
+        }
+        else if(strcmp(argv[i], "-hash") == 0 && i + 1 < argc)
+        {
+            hashMegaBytes = atoi(argv[++i]);
+            if(hashMegaBytes < 1)
+            {
+                printf("incorrect hash size.\n");
+                return 1;
+            }
+        }
+        else if(strcmp(argv[i], "-threads") == 0 && i + 1 < argc)
+        {
+            threadsAmount = atoi(argv[++i]);
+            if(threadsAmount < 1)
+            {
+                printf("incorrect threads amount.\n");
+                return 1;
+            }
+        }
+        else if(strcmp(argv[i], "-jobs") == 0 && i + 1 < argc)
+        {
+            jobsAmount = atoi(argv[++i]);
+            if(jobsAmount < 1)
+            {
+                printf("incorrect jobs amount.\n");
+                return 1;
+            }
+        }
+        else if(strcmp(argv[i], "-fen") == 0 && i + 1 < argc)
+            {fen = argv[++i];}
+        else if(strcmp(argv[i], "-dm") == 0 && i + 1 < argc)
+        {
+            defaultMoves = atoi(argv[++i]);
+            if(!getIsMovesAmountAllowed(defaultMoves))
+            {
+                printf("incorrect moves amount.\n");
+                return 1;
+            }
+        }
+        else if(strcmp(argv[i], "-batch") == 0)
+            {isBatch = true;}
+        else if(strcmp(argv[i], "-scan") == 0)
+            {isScan = true;}
+        else if(strcmp(argv[i], "-pack") == 0 && i + 1 < argc)
+            {packName = argv[++i];}
+        else if(strcmp(argv[i], "-results") == 0 && i + 1 < argc)
+            {resultsName = argv[++i];}
+        else if(strcmp(argv[i], "-showresults") == 0 && i + 1 < argc)
+            {shownResultsName = argv[++i];}
+        else if(strcmp(argv[i], "-shortest") == 0)
+            {isShortest = true;}
+        else if(strcmp(argv[i], "-allocs") == 0)
+            {isAllocationsReporting = true;}
+        else if(strcmp(argv[i], "-key") == 0)
+            {isKeyOnly = true;}
+        else if(strcmp(argv[i], "-cooks") == 0)
+            {isKeyOnly = true; isCooksCounting = true;}
+        else if(strcmp(argv[i], "-pns") == 0)
+            {isProofNumber = true;}
+        else if(strcmp(argv[i], "-pnsnodes") == 0 && i + 1 < argc)
+        {
+            proofNodesLimit = atoi(argv[++i]);
+            if(proofNodesLimit < 2)
+            {
+                printf("incorrect proof nodes limit.\n");
+                return 1;
+            }
+        }
+        else
+        {
+            fileName = argv[i];
+            batchNames.push_back(argv[i]);
+        }
+    }
+    
+    solveOptions options;
+    options.hashMegaBytes = hashMegaBytes;
+    options.threadsAmount = threadsAmount;
+    options.proofNodesLimit = proofNodesLimit;
+    options.isShortest = isShortest;
+    options.isProofNumber = isProofNumber;
+    options.isKeyOnly = isKeyOnly;
+    options.isCooksCounting = isCooksCounting;
+    
+    if(shownResultsName != NULL){return printBinaryResults(shownResultsName) ? 0 : 1;}
+    
+    if(isBatch || isScan || packName != NULL)
+    {
+        std::vector<std::string> fileNames;
+        for(size_t i = 0; i < batchNames.size(); i++)
+        {
+            if(!collectBatchFiles(batchNames[i], &fileNames)){return 1;}
+        }
+        if(packName != NULL){return packCorpora(&fileNames, packName, defaultMoves, true) ? 0 : 1;}
+        if(isScan){scanCorpora(&fileNames);}
+        else{solveBatch(&fileNames, jobsAmount, defaultMoves, &options, resultsName, true);}
+        
+        return 0;
+    }
+    
+    if(perftDepth > 0)
+    {
+        Chess position;
+        if(!loadPerftPosition(fen, fileName, defaultMoves, &position)){return 1;}
+        position.printDesk(false, 0, 0);
+        position.perftDivide(perftDepth);
+        
+        return 0;
+    }
+    
+    #ifndef NDEBUG
+        test1();
+        test2();
+        test3();
+        test4();
+        test5();
+    #endif
+    
+    printf("WHITE: ");
+    printf("K - King; Q - Queen; R - Rook; ");
+    printf("N - kNight; B - Bishop; P - Pawn;\n");
+    printf("BlACK: ");
+    printf("k - King; q - Queen; r - Rook; ");
+    printf("n - kNight; b - Bishop; p - Pawn;\n\n");
+    printf("Desk:\n");
+    
+    Chess problem01;
+    if(fen != NULL ? !loadChessProblemFromFen(fen, &problem01, false, defaultMoves, NULL) :
+                     !loadChessProblemFromFile(fileName, &problem01, false, defaultMoves))
+        {return 1;}
+    //"chess_01.txt"
+    //"chess_02.txt"
+    //"chess_03.txt"
+    //"chess_04.txt"
+    //"chess_05.txt"
+    //"chess_06.txt"
+    problem01.printDesk(false, 0, 0);
+    
+    //пути печатаются обходом дерева решения, без списка всех путей
+    resolutionPrinter printer;
+    solveProblem(&problem01, &options, &printer);
+    printf("\n");
+    
+    if(isAllocationsReporting)
+        {printf("HEAP ALLOCATIONS IN SEARCH: %llu\n", problem01.getSearchAllocationsAmount());}
+    
+    
+    return 0;
+}